@@ -0,0 +1,69 @@
+#version 400 core
+
+layout(vertices = 4) out;
+
+in vec2 rest_cs[];
+out vec2 rest_es[];
+
+uniform mat4 projection;
+uniform mat4 view;
+uniform mat4 model;
+uniform vec2 viewport;          // pixels
+uniform float edge_pixels;      // target length of one tessellated edge on screen
+uniform float margin;           // how far displacement can move the surface, simulation units
+
+// Segments for the edge a-b: the edge is treated as a sphere of its own length around
+// its midpoint, so both patches sharing it compute the same level and no cracks open.
+float edgeLevel(vec2 a, vec2 b) {
+	vec4 centre = view * model * vec4(0.5 * (a.x + b.x), 0.0, 0.5 * (a.y + b.y), 1.0);
+	float radius = length(vec3(model * vec4(b.x - a.x, 0.0, b.y - a.y, 0.0)));
+	float depth = max(-centre.z, 0.1);
+	float pixels = radius * projection[1][1] / depth * 0.5 * viewport.y;
+	return clamp(pixels / edge_pixels, 1.0, 64.0);
+}
+
+// true when the patch, grown by margin, lies entirely on the outside of one clip plane
+bool culled() {
+	vec4 c[4];
+	for (int i = 0; i < 4; i++) {
+		vec2 r = rest_cs[i];
+		vec2 grow = sign(r - 0.25 * (rest_cs[0] + rest_cs[1] + rest_cs[2] + rest_cs[3])) * margin;
+		c[i] = projection * view * model * vec4(r.x + grow.x, 0.0, r.y + grow.y, 1.0);
+	}
+	for (int axis = 0; axis < 3; axis++) {
+		bool below = true, above = true;
+		for (int i = 0; i < 4; i++) {
+			below = below && c[i][axis] < -c[i].w;
+			above = above && c[i][axis] >  c[i].w;
+		}
+		if (below || above) return true;
+	}
+	return false;
+}
+
+void main() {
+	rest_es[gl_InvocationID] = rest_cs[gl_InvocationID];
+
+	if (gl_InvocationID == 0) {
+		if (culled()) {
+			gl_TessLevelOuter[0] = 0.0;
+			gl_TessLevelOuter[1] = 0.0;
+			gl_TessLevelOuter[2] = 0.0;
+			gl_TessLevelOuter[3] = 0.0;
+			gl_TessLevelInner[0] = 0.0;
+			gl_TessLevelInner[1] = 0.0;
+		} else {
+			// corners run (0,0) (1,0) (1,1) (0,1) in (u,v)
+			float u0 = edgeLevel(rest_cs[0], rest_cs[3]);
+			float v0 = edgeLevel(rest_cs[0], rest_cs[1]);
+			float u1 = edgeLevel(rest_cs[1], rest_cs[2]);
+			float v1 = edgeLevel(rest_cs[3], rest_cs[2]);
+			gl_TessLevelOuter[0] = u0;
+			gl_TessLevelOuter[1] = v0;
+			gl_TessLevelOuter[2] = u1;
+			gl_TessLevelOuter[3] = v1;
+			gl_TessLevelInner[0] = max(v0, v1);
+			gl_TessLevelInner[1] = max(u0, u1);
+		}
+	}
+}
@@ -0,0 +1,42 @@
+#version 400 core
+
+layout(quads, fractional_even_spacing, ccw) in;
+
+in vec2 rest_es[];
+
+uniform mat4 projection;
+uniform mat4 view;
+uniform mat4 model;
+uniform vec3 light_position;
+uniform sampler2D displacement;     // dx, height, dz of the last simulation frame
+uniform sampler2D normals;
+uniform float patch_length;
+uniform vec2 texel_offset;          // rest position 0 sits half a patch plus half a texel in
+
+out vec3 light_vector;
+out vec3 normal_vector;
+out vec3 halfway_vector;
+out vec3 reflected;
+
+void main() {
+	vec2 rest = mix(mix(rest_es[0], rest_es[1], gl_TessCoord.x),
+	                mix(rest_es[3], rest_es[2], gl_TessCoord.x), gl_TessCoord.y);
+	vec2 uv = rest / patch_length + texel_offset;
+
+	vec3 d = texture(displacement, uv).xyz;
+	vec3 vertex = vec3(rest.x + d.x, d.y, rest.y + d.z);
+	vec3 normal = normalize(texture(normals, uv).xyz);
+
+	vec3 pos_eye = normalize(vec3(view * model * vec4(vertex, 1.0)));
+	vec3 n_eye = normalize(vec3(view * model * vec4(normal, 0.0)));
+
+	reflected = vec3(inverse(view) * vec4(reflect(pos_eye, n_eye), 0.0));
+
+	gl_Position = projection * view * model * vec4(vertex, 1.0);
+
+	vec4 v = view * model * vec4(vertex, 1.0);
+
+	light_vector = normalize((view * vec4(light_position, 1.0)).xyz - v.xyz);
+	normal_vector = (inverse(transpose(view * model)) * vec4(normal, 0.0)).xyz;
+	halfway_vector = light_vector + normalize(-v.xyz);
+}
@@ -0,0 +1,12 @@
+#version 400 core
+
+// coarse patch corner on the water plane, in patch lengths
+in vec2 vertex;
+
+uniform float patch_length;
+
+out vec2 rest_cs;
+
+void main() {
+	rest_cs = vertex * patch_length;
+}
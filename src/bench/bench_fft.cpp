@@ -0,0 +1,282 @@
+// Microbenchmark of cFFT on its own. For every size it times
+//   1d          one contiguous transform
+//   1d-strided  one transform reading and writing every 64th element
+//   1d-batch    64 contiguous transforms back to back through one cFFT
+//   2d-rows     the row pass of an N x N transform (N contiguous transforms)
+//   2d-columns  the column pass (N transforms at stride N)
+//   2d          both passes
+// and reports ns per transform, GFLOP/s counted as 5 N log2 N per 1d transform and
+// the error against a double precision DFT, relative to the largest output.
+//
+//   bench_fft [--sizes 16,32,...] [--sizes-2d 16,32,...] [--min-time seconds] [--json file|-]
+#include "../entities/fft.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+enum fft_case { CASE_1D, CASE_1D_STRIDED, CASE_1D_BATCH, CASE_2D_ROWS, CASE_2D_COLUMNS, CASE_2D };
+static const char *case_names[] = { "1d", "1d-strided", "1d-batch", "2d-rows", "2d-columns", "2d" };
+
+static const int strided = 64;      // element step of the strided case
+static const int batch   = 64;      // transforms in the batched case
+
+struct fft_result {
+    int N;
+    fft_case which;
+    int transforms;             // 1d transforms per timed run
+    int runs;
+    double ns_run;              // median of the timed runs
+    double max_error, rms_error;
+};
+
+static std::vector<int> parseList(const char *s) {
+    std::vector<int> list;
+    while (*s) {
+        char *end;
+        long v = strtol(s, &end, 10);
+        if (end == s) break;
+        list.push_back((int)v);
+        s = *end == ',' ? end + 1 : end;
+    }
+    return list;
+}
+
+// cFFT computes X[k] = sum_n x[n] exp(+2 pi i n k / N), unscaled. One output bin in
+// double, the twiddle angle reduced modulo N exactly in integers.
+static void referenceBin(const complex *x, int N, int stride, int k, double &re, double &im) {
+    re = im = 0.0;
+    for (int n = 0; n < N; n++) {
+        double angle = 2.0 * M_PI * (double)(((long long)n * k) % N) / N;
+        double c = cos(angle), s = sin(angle);
+        const complex &v = x[(size_t)n * stride];
+        re += v.a * c - v.b * s;
+        im += v.a * s + v.b * c;
+    }
+}
+
+static void referenceBin(const double *x_re, const double *x_im, int N, int k, double &re, double &im) {
+    re = im = 0.0;
+    for (int n = 0; n < N; n++) {
+        double angle = 2.0 * M_PI * (double)(((long long)n * k) % N) / N;
+        double c = cos(angle), s = sin(angle);
+        re += x_re[n] * c - x_im[n] * s;
+        im += x_re[n] * s + x_im[n] * c;
+    }
+}
+
+static void fill(std::vector<complex> &data) {
+    unsigned int state = 12345;
+    for (size_t i = 0; i < data.size(); i++) {
+        state = state * 1664525u + 1013904223u;
+        float a = (state >> 8) / 16777216.0f - 0.5f;
+        state = state * 1664525u + 1013904223u;
+        float b = (state >> 8) / 16777216.0f - 0.5f;
+        data[i] = complex(a, b);
+    }
+}
+
+// one timed run of the case, input is left untouched
+static void transform(cFFT &fft, fft_case which, int N, complex *input, complex *output) {
+    switch (which) {
+    case CASE_1D:
+        fft.fft(input, output, 1, 0);
+        break;
+    case CASE_1D_STRIDED:
+        fft.fft(input, output, strided, 0);
+        break;
+    case CASE_1D_BATCH:
+        for (int b = 0; b < batch; b++) fft.fft(input, output, 1, b * N);
+        break;
+    case CASE_2D_ROWS:
+        for (int m = 0; m < N; m++) fft.fft(input, output, 1, m * N);
+        break;
+    case CASE_2D_COLUMNS:
+        for (int n = 0; n < N; n++) fft.fft(input, output, N, n);
+        break;
+    case CASE_2D:
+        for (int m = 0; m < N; m++) fft.fft(input, output, 1, m * N);
+        for (int n = 0; n < N; n++) fft.fft(output, output, N, n);
+        break;
+    }
+}
+
+// Error of a few output bins per transform against referenceBin. The 2d reference is
+// the row reference of every column entry followed by the column reference, only
+// for a handful of bins since it costs N^2 per bin.
+static void measureError(fft_case which, int N, const complex *input, const complex *output,
+                         double &max_error, double &rms_error) {
+    std::vector<int> bins;
+    int count = which == CASE_2D ? 8 : std::min(N, 64);
+    for (int i = 0; i < count; i++) bins.push_back((int)((long long)i * 7919 % N));
+
+    double peak = 0.0, worst = 0.0, sum = 0.0;
+    int samples = 0;
+    int lines = which == CASE_1D_BATCH ? batch : (which == CASE_2D_ROWS || which == CASE_2D_COLUMNS) ? N : 1;
+    for (int line = 0; line < lines; line += std::max(1, lines / 4)) {
+        for (size_t b = 0; b < bins.size(); b++) {
+            int k = bins[b];
+            double re, im;
+            const complex *got;
+            if (which == CASE_2D) {
+                int kz = bins[(b * 3) % bins.size()];
+                std::vector<double> column_re(N), column_im(N);
+                for (int m = 0; m < N; m++) referenceBin(input + (size_t)m * N, N, 1, k, column_re[m], column_im[m]);
+                referenceBin(&column_re[0], &column_im[0], N, kz, re, im);
+                got = output + (size_t)kz * N + k;
+            } else {
+                int stride = which == CASE_1D_STRIDED ? strided : which == CASE_2D_COLUMNS ? N : 1;
+                size_t start = which == CASE_2D_COLUMNS ? line : (size_t)line * N;
+                referenceBin(input + start, N, stride, k, re, im);
+                got = output + start + (size_t)k * stride;
+            }
+            double e = sqrt((got->a - re) * (got->a - re) + (got->b - im) * (got->b - im));
+            peak = std::max(peak, sqrt(re * re + im * im));
+            worst = std::max(worst, e);
+            sum += e * e;
+            samples++;
+        }
+    }
+    max_error = peak > 0.0 ? worst / peak : worst;
+    rms_error = peak > 0.0 ? sqrt(sum / samples) / peak : 0.0;
+}
+
+static fft_result run(int N, fft_case which, double min_time) {
+    typedef std::chrono::steady_clock clock;
+    size_t elements = which == CASE_1D ? N : which == CASE_1D_STRIDED ? (size_t)N * strided :
+                      which == CASE_1D_BATCH ? (size_t)N * batch : (size_t)N * N;
+    std::vector<complex> input(elements), output(elements);
+    fill(input);
+    cFFT fft(N);
+
+    fft_result r;
+    r.N          = N;
+    r.which      = which;
+    r.transforms = which == CASE_1D_BATCH ? batch : which == CASE_2D ? 2 * N :
+                   (which == CASE_2D_ROWS || which == CASE_2D_COLUMNS) ? N : 1;
+
+    transform(fft, which, N, &input[0], &output[0]);            // warm up
+    measureError(which, N, &input[0], &output[0], r.max_error, r.rms_error);
+
+    // small cases are timed in groups so each sample is well above the clock resolution
+    int repeat = 1;
+    for (;;) {
+        clock::time_point a = clock::now();
+        for (int i = 0; i < repeat; i++) transform(fft, which, N, &input[0], &output[0]);
+        if (std::chrono::duration<double>(clock::now() - a).count() > 1e-4 || repeat >= (1 << 20)) break;
+        repeat *= 2;
+    }
+
+    std::vector<double> samples;
+    clock::time_point start = clock::now();
+    do {
+        clock::time_point a = clock::now();
+        for (int i = 0; i < repeat; i++) transform(fft, which, N, &input[0], &output[0]);
+        clock::time_point b = clock::now();
+        samples.push_back(std::chrono::duration<double, std::nano>(b - a).count() / repeat);
+    } while (samples.size() < 5 || std::chrono::duration<double>(clock::now() - start).count() < min_time);
+
+    std::sort(samples.begin(), samples.end());
+    r.runs   = samples.size() * repeat;
+    r.ns_run = samples[samples.size() / 2];
+    return r;
+}
+
+static double flops(const fft_result &r) {
+    return r.transforms * 5.0 * r.N * log2((double)r.N);
+}
+
+static void writeJson(FILE *f, const std::vector<fft_result> &results, double min_time) {
+    char date[32];
+    time_t now = time(0);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+    fprintf(f, "{\n");
+    fprintf(f, "  \"benchmark\": \"bench_fft\",\n");
+    fprintf(f, "  \"date\": \"%s\",\n", date);
+    fprintf(f, "  \"compiler\": \"%s\",\n", __VERSION__);
+    fprintf(f, "  \"min_time_s\": %g,\n", min_time);
+    fprintf(f, "  \"results\": [\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const fft_result &r = results[i];
+        fprintf(f, "    { \"N\": %d, \"case\": \"%s\", \"transforms\": %d, \"runs\": %d, "
+                   "\"ns_per_run\": %.1f, \"ns_per_transform\": %.1f, \"gflops\": %.4f, "
+                   "\"max_rel_error\": %.3e, \"rms_rel_error\": %.3e }%s\n",
+                r.N, case_names[r.which], r.transforms, r.runs, r.ns_run, r.ns_run / r.transforms,
+                flops(r) / r.ns_run, r.max_error, r.rms_error, i + 1 < results.size() ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+}
+
+static void usage() {
+    fprintf(stderr, "usage: bench_fft [--sizes 16,32,...] [--sizes-2d 16,32,...] [--min-time seconds] [--json file|-]\n");
+}
+
+int main(int argc, char *argv[]) {
+#ifndef __OPTIMIZE__
+    fprintf(stderr, "warning: bench_fft was built without optimisation, time it from make config=release\n");
+#endif
+    std::vector<int> sizes, sizes_2d;
+    for (int N = 16; N <= 4096; N *= 2) sizes.push_back(N);
+    for (int N = 16; N <= 1024; N *= 2) sizes_2d.push_back(N);      // 2048^2 and up take seconds per run
+    double min_time = 0.2;
+    const char *json = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i], *value = i + 1 < argc ? argv[i + 1] : 0;
+        if (!value) {
+            usage();
+            return 1;
+        }
+        if      (!strcmp(arg, "--sizes"))    sizes = parseList(value);
+        else if (!strcmp(arg, "--sizes-2d")) sizes_2d = parseList(value);
+        else if (!strcmp(arg, "--min-time")) min_time = atof(value);
+        else if (!strcmp(arg, "--json"))     json = value;
+        else {
+            usage();
+            return 1;
+        }
+        i++;
+    }
+    for (int pass = 0; pass < 2; pass++) {
+        const std::vector<int> &list = pass ? sizes_2d : sizes;
+        for (size_t i = 0; i < list.size(); i++) {
+            if (list[i] < 2 || (list[i] & (list[i] - 1))) {
+                fprintf(stderr, "N = %d is not a power of two >= 2\n", list[i]);
+                return 1;
+            }
+        }
+    }
+
+    FILE *table = json && !strcmp(json, "-") ? stderr : stdout;
+    fprintf(table, "%5s %-11s %10s %14s %14s %9s %11s %11s\n",
+            "N", "case", "runs", "ns/run", "ns/transform", "GFLOP/s", "max error", "rms error");
+
+    std::vector<fft_result> results;
+    for (int c = CASE_1D; c <= CASE_2D; c++) {
+        const std::vector<int> &list = c >= CASE_2D_ROWS ? sizes_2d : sizes;
+        for (size_t i = 0; i < list.size(); i++) {
+            fft_result r = run(list[i], (fft_case)c, min_time);
+            results.push_back(r);
+            fprintf(table, "%5d %-11s %10d %14.1f %14.1f %9.3f %11.2e %11.2e\n",
+                    r.N, case_names[r.which], r.runs, r.ns_run, r.ns_run / r.transforms,
+                    flops(r) / r.ns_run, r.max_error, r.rms_error);
+            fflush(table);
+        }
+    }
+
+    if (json) {
+        FILE *f = strcmp(json, "-") ? fopen(json, "w") : stdout;
+        if (!f) {
+            fprintf(stderr, "cannot write %s\n", json);
+            return 1;
+        }
+        writeJson(f, results, min_time);
+        if (f != stdout) fclose(f);
+    }
+    return 0;
+}
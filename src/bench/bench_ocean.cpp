@@ -0,0 +1,396 @@
+// Headless throughput of the ocean simulation. Every combination of resolution, worker
+// thread count and mode evaluates frames at advancing times until both a minimum frame
+// count and a minimum run time are reached; the frame times are reported as ns per
+// texel and percentiles, next to an estimate of the memory traffic per frame.
+//
+// With --counters every combination gets a second, untimed pass with the hardware
+// counters read around each named stage of the simulation (spectrum, rows, columns,
+// output, ...), reported as time, IPC and misses per texel. The counts are those of
+// the thread running the frame, so stages that go through Parallel (spectrum, rows,
+// columns, ...) are only complete with --threads 1. Without perf_event access the
+// stages show their time only.
+//
+// --validate N times nothing: it checks every FFT mode at resolution N against the
+// direct sum (compareReference) and, for the difference mode, the angle between its
+// normals and the FFT ones (compareNormals). The direct sum is O(N^4), N = 256 takes
+// seconds.
+//
+//   bench_ocean [--sizes 64,128,...] [--threads 1,2,...] [--modes fft,difference,...]
+//               [--min-time seconds] [--min-frames n] [--counters] [--json file|-]
+//   bench_ocean --validate N [--modes fft,difference,...]
+#include "../entities/OceanSimulation.h"
+#include "../entities/Parallel.h"
+#include "../entities/PerfCounters.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <thread>
+
+struct bench_mode {
+    const char *name;
+    const char *description;
+};
+
+static const bench_mode modes[] = {
+    { "fft",        "FFT, analytic normals" },
+    { "difference", "FFT, normals from height differences" },
+    { "pruned",     "FFT, bins below 1e-4 of the peak energy dropped" },
+    { "lod",        "FFT, detail level 1 (N/2 transform, upsampled)" },
+    { "gerstner",   "256 Gerstner waves summed directly" },
+};
+static const int mode_count = sizeof(modes) / sizeof(modes[0]);
+
+struct bench_result {
+    int N, threads, mode;
+    int frames;
+    double mean, p50, p90, p99, min, max;   // ns per frame
+    double bytes;                           // estimated per frame
+    int counted_frames;                     // of the --counters pass, 0 without it
+    bool available[PERF_EVENTS];
+    std::vector<perf_stage> stages;
+};
+
+static const int counted_frames = 20;
+
+static std::vector<int> parseList(const char *s) {
+    std::vector<int> list;
+    while (*s) {
+        char *end;
+        long v = strtol(s, &end, 10);
+        if (end == s) break;
+        list.push_back((int)v);
+        s = *end == ',' ? end + 1 : end;
+    }
+    return list;
+}
+
+static void configure(OceanSimulation &simulation, int mode) {
+    simulation.setNormalMode(mode == 1 ? OCEAN_NORMALS_DIFFERENCE : OCEAN_NORMALS_FFT);
+    simulation.setPruneThreshold(mode == 2 ? 1e-4f : 0.0f);
+    simulation.setDetail(mode == 3 ? 1.0f : 0.0f);
+    simulation.setWaveModel(mode == 4 ? OCEAN_WAVES_GERSTNER : OCEAN_WAVES_FFT, 256);
+}
+
+// Bytes a frame has to move at least once: the spectrum tables read, the spectrum
+// buffers written, read and written again by the row and the column pass of every
+// transform and read once more into the six output grids. Pruning and LOD shrink
+// the transforms, that is scaled by the fraction of bins kept.
+static double frameBytes(const OceanSimulation &simulation, int N, int mode) {
+    double texels = (double)N * N, table = (double)(N + 1) * (N + 1);
+    double out = 6 * texels * sizeof(float);
+    if (mode == 4) return 256 * (sizeof(gerstner_wave) + 2 * N * sizeof(float)) + out;
+
+    int buffers = mode == 1 ? 3 : 5;        // difference normals skip the two slope transforms
+    double spectrum = buffers * texels * sizeof(complex);
+    double kept = simulation.pruneStats().bins_kept;
+    if (mode == 3) kept = 0.25;
+    return table * (2 * sizeof(complex) + sizeof(float)) +
+           kept * (spectrum + 4 * spectrum) + spectrum + out;
+}
+
+static double percentile(const std::vector<double> &sorted, double p) {
+    double position = p * (sorted.size() - 1);
+    size_t i = (size_t)position;
+    if (i + 1 >= sorted.size()) return sorted.back();
+    return sorted[i] + (sorted[i + 1] - sorted[i]) * (position - i);
+}
+
+static void evaluate(OceanSimulation &simulation, int mode, float t) {
+    if (mode == 4) simulation.evaluateWavesGerstner(t);
+    else           simulation.evaluateWavesFFT(t);
+}
+
+// count per texel and frame of one stage, negative if the event is not available
+static double perTexel(const bench_result &r, const perf_stage &stage, perf_event e) {
+    if (!r.available[e]) return -1.0;
+    return (double)stage.total.count[e] / stage.calls / ((double)r.N * r.N);
+}
+
+static double ipc(const bench_result &r, const perf_stage &stage) {
+    if (!r.available[PERF_CYCLES] || !r.available[PERF_INSTRUCTIONS] || !stage.total.count[PERF_CYCLES]) return -1.0;
+    return (double)stage.total.count[PERF_INSTRUCTIONS] / stage.total.count[PERF_CYCLES];
+}
+
+static bench_result run(int N, int threads, int mode, double min_time, int min_frames, bool counters) {
+    typedef std::chrono::steady_clock clock;
+    Parallel::setThreads(threads);
+
+    OceanSimulation simulation(N, 0.0005f, vector2(32.0f, 32.0f), 64);
+    configure(simulation, mode);
+
+    // one untimed frame pulls everything into cache and allocates lazy buffers
+    evaluate(simulation, mode, 0.0f);
+
+    std::vector<double> times;
+    clock::time_point start = clock::now();
+    for (int frame = 1; ; frame++) {
+        float t = frame / 30.0f;
+        clock::time_point a = clock::now();
+        evaluate(simulation, mode, t);
+        clock::time_point b = clock::now();
+        times.push_back(std::chrono::duration<double, std::nano>(b - a).count());
+
+        double elapsed = std::chrono::duration<double>(b - start).count();
+        if ((int)times.size() >= min_frames && elapsed >= min_time) break;
+        if (times.size() >= 10000) break;
+    }
+
+    bench_result r;
+    r.N       = N;
+    r.threads = threads;
+    r.mode    = mode;
+    r.frames  = times.size();
+    r.bytes   = frameBytes(simulation, N, mode);
+    double sum = 0.0;
+    for (size_t i = 0; i < times.size(); i++) sum += times[i];
+    std::sort(times.begin(), times.end());
+    r.mean = sum / times.size();
+    r.p50  = percentile(times, 0.50);
+    r.p90  = percentile(times, 0.90);
+    r.p99  = percentile(times, 0.99);
+    r.min  = times.front();
+    r.max  = times.back();
+
+    // the counter reads cost a few syscalls per stage, they get a pass of their own
+    r.counted_frames = 0;
+    for (int e = 0; e < PERF_EVENTS; e++) r.available[e] = false;
+    if (counters) {
+        PerfStages stages;
+        stages.install();
+        for (int frame = 0; frame < counted_frames; frame++) evaluate(simulation, mode, (frame + 1) / 30.0f);
+        r.counted_frames = counted_frames;
+        for (int e = 0; e < PERF_EVENTS; e++) r.available[e] = stages.events().available((perf_event)e);
+        stages.uninstall();
+        for (int i = 0; i < stages.size(); i++) r.stages.push_back(stages.stage(i));
+    }
+    return r;
+}
+
+static void printStages(FILE *f, const bench_result &r) {
+    static const perf_event misses[] = { PERF_L1D_MISSES, PERF_LLC_MISSES, PERF_DTLB_MISSES, PERF_BRANCH_MISSES };
+    for (size_t i = 0; i < r.stages.size(); i++) {
+        const perf_stage &stage = r.stages[i];
+        char column[5][16];
+        double v = ipc(r, stage);
+        if (v < 0.0) strcpy(column[0], "-");
+        else         snprintf(column[0], sizeof(column[0]), "%.2f", v);
+        for (int m = 0; m < 4; m++) {
+            v = perTexel(r, stage, misses[m]);
+            if (v < 0.0) strcpy(column[m + 1], "-");
+            else         snprintf(column[m + 1], sizeof(column[m + 1]), "%.4f", v);
+        }
+        fprintf(f, "%21s %-10s %6d %10.3f %6s %10s %10s %10s %10s\n", "", stage.name, stage.calls / r.counted_frames,
+                stage.total.ns / stage.calls / ((double)r.N * r.N), column[0], column[1], column[2], column[3], column[4]);
+    }
+}
+
+static void jsonNumber(FILE *f, const char *key, double value, const char *format) {
+    fprintf(f, ", \"%s\": ", key);
+    if (value < 0.0) fprintf(f, "null");
+    else             fprintf(f, format, value);
+}
+
+static void writeStages(FILE *f, const bench_result &r) {
+    fprintf(f, ",\n      \"counted_frames\": %d, \"stages\": [", r.counted_frames);
+    for (size_t i = 0; i < r.stages.size(); i++) {
+        const perf_stage &stage = r.stages[i];
+        fprintf(f, "%s\n        { \"name\": \"%s\", \"calls_per_frame\": %.2f, \"ns_per_texel\": %.4f",
+                i ? "," : "", stage.name, (double)stage.calls / r.counted_frames,
+                stage.total.ns / stage.calls / ((double)r.N * r.N));
+        jsonNumber(f, "ipc", ipc(r, stage), "%.3f");
+        jsonNumber(f, "l1d_misses_per_texel", perTexel(r, stage, PERF_L1D_MISSES), "%.5f");
+        jsonNumber(f, "llc_misses_per_texel", perTexel(r, stage, PERF_LLC_MISSES), "%.5f");
+        jsonNumber(f, "dtlb_misses_per_texel", perTexel(r, stage, PERF_DTLB_MISSES), "%.5f");
+        jsonNumber(f, "branch_misses_per_texel", perTexel(r, stage, PERF_BRANCH_MISSES), "%.5f");
+        fprintf(f, " }");
+    }
+    fprintf(f, " ]");
+}
+
+static void writeJson(FILE *f, const std::vector<bench_result> &results, double min_time, int min_frames) {
+    char date[32];
+    time_t now = time(0);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+    fprintf(f, "{\n");
+    fprintf(f, "  \"benchmark\": \"bench_ocean\",\n");
+    fprintf(f, "  \"date\": \"%s\",\n", date);
+    fprintf(f, "  \"compiler\": \"%s\",\n", __VERSION__);
+    fprintf(f, "  \"hardware_threads\": %u,\n", std::thread::hardware_concurrency());
+    fprintf(f, "  \"min_time_s\": %g,\n", min_time);
+    fprintf(f, "  \"min_frames\": %d,\n", min_frames);
+    fprintf(f, "  \"results\": [\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const bench_result &r = results[i];
+        double texels = (double)r.N * r.N;
+        fprintf(f, "    { \"N\": %d, \"threads\": %d, \"mode\": \"%s\", \"frames\": %d, "
+                   "\"ns_per_texel\": %.4f, \"mean_ns\": %.0f, \"p50_ns\": %.0f, \"p90_ns\": %.0f, "
+                   "\"p99_ns\": %.0f, \"min_ns\": %.0f, \"max_ns\": %.0f, \"bytes_per_frame\": %.0f, "
+                   "\"gb_per_s\": %.3f",
+                r.N, r.threads, modes[r.mode].name, r.frames, r.mean / texels, r.mean, r.p50, r.p90,
+                r.p99, r.min, r.max, r.bytes, r.bytes / r.mean);
+        if (r.counted_frames) writeStages(f, r);
+        fprintf(f, " }%s\n", i + 1 < results.size() ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+}
+
+// max and RMS error of each FFT mode against the direct sum at one time; Gerstner is
+// a different wave model and has no reference
+static void validate(FILE *out, int N, const std::vector<int> &selected) {
+    const float t = 3.3f;
+    fprintf(out, "%5s %-11s %12s %12s %12s %12s %12s %12s\n",
+            "N", "mode", "h max", "h rms", "D max", "D rms", "n max deg", "n rms deg");
+    for (size_t m = 0; m < selected.size(); m++) {
+        int mode = selected[m];
+        if (mode == 4) {
+            fprintf(out, "%5d %-11s no reference\n", N, modes[mode].name);
+            continue;
+        }
+        OceanSimulation simulation(N, 0.0005f, vector2(32.0f, 32.0f), 64);
+        configure(simulation, mode);
+        ocean_reference_error error;
+        simulation.compareReference(t, error);
+        fprintf(out, "%5d %-11s %12.3g %12.3g %12.3g %12.3g %12.3g %12.3g\n", N, modes[mode].name,
+                error.height_max, error.height_rms, error.displacement_max, error.displacement_rms,
+                error.normal_max_degrees, error.normal_rms_degrees);
+        if (mode == 2)
+            fprintf(out, "%5s %-11s %12.3g %12s %12.3g\n", "", "bound",
+                    simulation.pruneStats().height_error, "", simulation.pruneStats().height_error);
+        if (mode == 1) {
+            float max_degrees, rms_degrees;
+            simulation.compareNormals(t, max_degrees, rms_degrees);
+            fprintf(out, "%5s %-11s %12s %12s %12s %12s %12.3g %12.3g\n", "", "vs FFT",
+                    "", "", "", "", max_degrees, rms_degrees);
+        }
+        fflush(out);
+    }
+}
+
+static void usage() {
+    fprintf(stderr, "usage: bench_ocean [--sizes 64,128,...] [--threads 1,2,...] [--modes name,...]\n"
+                    "                   [--min-time seconds] [--min-frames n] [--counters] [--json file|-]\n"
+                    "       bench_ocean --validate N [--modes name,...]\n"
+                    "modes:\n");
+    for (int m = 0; m < mode_count; m++) fprintf(stderr, "  %-11s %s\n", modes[m].name, modes[m].description);
+}
+
+int main(int argc, char *argv[]) {
+#ifndef __OPTIMIZE__
+    fprintf(stderr, "warning: bench_ocean was built without optimisation, time it from make config=release\n");
+#endif
+    std::vector<int> sizes;
+    for (int N = 64; N <= 2048; N *= 2) sizes.push_back(N);
+    std::vector<int> thread_counts;
+    int hardware = std::max(1u, std::thread::hardware_concurrency());
+    for (int t = 1; t < hardware; t *= 2) thread_counts.push_back(t);
+    thread_counts.push_back(hardware);
+    std::vector<int> selected;
+    for (int m = 0; m < mode_count; m++) selected.push_back(m);
+    double min_time = 0.5;
+    int min_frames = 5;
+    const char *json = 0;
+    bool counters = false;
+    int validate_N = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i], *value = i + 1 < argc ? argv[i + 1] : 0;
+        if (!strcmp(arg, "--counters")) {
+            counters = true;
+            continue;
+        }
+        if (!value) {
+            usage();
+            return 1;
+        }
+        if (!strcmp(arg, "--sizes")) {
+            sizes = parseList(value);
+        } else if (!strcmp(arg, "--threads")) {
+            thread_counts = parseList(value);
+        } else if (!strcmp(arg, "--modes")) {
+            selected.clear();
+            std::string list = std::string(value) + ",";
+            for (size_t a = 0, b; (b = list.find(',', a)) != std::string::npos; a = b + 1) {
+                std::string name = list.substr(a, b - a);
+                int m = 0;
+                while (m < mode_count && name != modes[m].name) m++;
+                if (m == mode_count) {
+                    fprintf(stderr, "unknown mode '%s'\n", name.c_str());
+                    usage();
+                    return 1;
+                }
+                selected.push_back(m);
+            }
+        } else if (!strcmp(arg, "--min-time")) {
+            min_time = atof(value);
+        } else if (!strcmp(arg, "--min-frames")) {
+            min_frames = atoi(value);
+        } else if (!strcmp(arg, "--json")) {
+            json = value;
+        } else if (!strcmp(arg, "--validate")) {
+            validate_N = atoi(value);
+        } else {
+            usage();
+            return 1;
+        }
+        i++;
+    }
+    if (validate_N) sizes.assign(1, validate_N);
+    for (size_t i = 0; i < sizes.size(); i++) {
+        if (sizes[i] < 4 || (sizes[i] & (sizes[i] - 1))) {
+            fprintf(stderr, "N = %d is not a power of two >= 4\n", sizes[i]);
+            return 1;
+        }
+    }
+    if (validate_N) {
+        validate(stdout, validate_N, selected);
+        return 0;
+    }
+
+    // with --json - the table goes to stderr so stdout stays parseable
+    FILE *table = json && !strcmp(json, "-") ? stderr : stdout;
+    if (counters) {
+        PerfCounters probe;
+        if (!probe.open())
+            fprintf(table, "hardware counters unavailable (%s), stages show time only\n", strerror(probe.openError()));
+        else
+            for (int e = 0; e < PERF_EVENTS; e++)
+                if (!probe.available((perf_event)e)) fprintf(table, "%s not available\n", PerfCounters::name((perf_event)e));
+    }
+    fprintf(table, "%5s %3s %-11s %6s %10s %12s %12s %12s %12s %10s %8s\n",
+            "N", "thr", "mode", "frames", "ns/texel", "mean ms", "p50 ms", "p90 ms", "p99 ms", "MB/frame", "GB/s");
+    if (counters)
+        fprintf(table, "%21s %-10s %6s %10s %6s %10s %10s %10s %10s\n",
+                "", "stage", "calls", "ns/texel", "IPC", "L1d/texel", "LLC/texel", "dTLB/texel", "br/texel");
+
+    std::vector<bench_result> results;
+    for (size_t s = 0; s < sizes.size(); s++) {
+        for (size_t t = 0; t < thread_counts.size(); t++) {
+            for (size_t m = 0; m < selected.size(); m++) {
+                bench_result r = run(sizes[s], thread_counts[t], selected[m], min_time, min_frames, counters);
+                results.push_back(r);
+                fprintf(table, "%5d %3d %-11s %6d %10.3f %12.3f %12.3f %12.3f %12.3f %10.2f %8.2f\n",
+                        r.N, r.threads, modes[r.mode].name, r.frames, r.mean / ((double)r.N * r.N),
+                        r.mean * 1e-6, r.p50 * 1e-6, r.p90 * 1e-6, r.p99 * 1e-6, r.bytes * 1e-6, r.bytes / r.mean);
+                printStages(table, r);
+                fflush(table);
+            }
+        }
+    }
+
+    if (json) {
+        FILE *f = strcmp(json, "-") ? fopen(json, "w") : stdout;
+        if (!f) {
+            fprintf(stderr, "cannot write %s\n", json);
+            return 1;
+        }
+        writeJson(f, results, min_time, min_frames);
+        if (f != stdout) fclose(f);
+    }
+    return 0;
+}
@@ -0,0 +1,46 @@
+#include "Arena.h"
+#include <new>
+#include <sys/mman.h>
+
+static const size_t huge_page = 2 * 1024 * 1024;
+
+Arena::Arena(size_t bytes, arena_pages pages) : base(0), size(0), used(0), pages(pages) {
+    void *mapping = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+    if (pages == ARENA_PAGES_HUGETLB) {
+        size    = (bytes + huge_page - 1) & ~(huge_page - 1);
+        mapping = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (mapping == MAP_FAILED) this->pages = ARENA_PAGES_TRANSPARENT;     // pool empty or unsupported
+    }
+#else
+    if (pages == ARENA_PAGES_HUGETLB) this->pages = ARENA_PAGES_TRANSPARENT;
+#endif
+
+    if (mapping == MAP_FAILED) {
+        size    = bytes > 0 ? bytes : 1;
+        mapping = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapping == MAP_FAILED) throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE
+        if (this->pages == ARENA_PAGES_TRANSPARENT && madvise(mapping, size, MADV_HUGEPAGE) != 0) {
+            this->pages = ARENA_PAGES_DEFAULT;
+        }
+#else
+        this->pages = ARENA_PAGES_DEFAULT;
+#endif
+    }
+    base = (char *)mapping;
+}
+
+Arena::~Arena() {
+    if (base) munmap(base, size);
+}
+
+// next block of bytes, 64-byte aligned; 0 once the arena is exhausted
+void* Arena::take(size_t bytes) {
+    size_t block = blockSize(bytes);
+    if (used + block > size) return 0;
+    void *p = base + used;
+    used += block;
+    return p;
+}
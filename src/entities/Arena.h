@@ -0,0 +1,40 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+enum arena_pages {
+    ARENA_PAGES_DEFAULT,        // plain anonymous mapping
+    ARENA_PAGES_TRANSPARENT,    // madvise(MADV_HUGEPAGE): huge pages when the kernel has them
+    ARENA_PAGES_HUGETLB         // MAP_HUGETLB from the reserved pool, transparent if that fails
+};
+
+
+
+
+// One anonymous mapping carved into 64-byte aligned blocks. Blocks are handed out in
+// order and live as long as the arena; the mapping starts zero filled. Size it with
+// blockSize() over every block that will be taken.
+class Arena {
+  private:
+    char *base;
+    size_t size, used;
+    arena_pages pages;          // what the mapping actually got
+
+  protected:
+  public:
+    static const size_t alignment = 64;
+    static size_t blockSize(size_t bytes) { return (bytes + alignment - 1) & ~(alignment - 1); }
+
+    Arena(size_t bytes, arena_pages pages = ARENA_PAGES_DEFAULT);
+    ~Arena();
+
+    void* take(size_t bytes);
+    template <class T> T* take(size_t count) { return (T*)take(count * sizeof(T)); }
+
+    size_t capacity() const { return size; }
+    size_t usedBytes() const { return used; }
+    arena_pages backing() const { return pages; }
+};
+
+#endif
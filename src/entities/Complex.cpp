@@ -1,7 +1,7 @@
 #include "Complex.h"
 
-unsigned int complex::additions = 0;
-unsigned int complex::multiplications = 0;
+thread_local unsigned int complex::additions = 0;
+thread_local unsigned int complex::multiplications = 0;
 
 complex::complex() : a(0.0f), b(0.0f) { }
 complex::complex(float a, float b) : a(a), b(b) { }
@@ -6,7 +6,7 @@ class complex {
   protected:
   public:
     float a, b;
-    static unsigned int additions, multiplications;
+    static thread_local unsigned int additions, multiplications;   // of the calling thread
     complex();
     complex(float a, float b);
     complex conj();
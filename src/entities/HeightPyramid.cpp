@@ -0,0 +1,142 @@
+#include "HeightPyramid.h"
+#include <math.h>
+
+// plain compares, fminf/fmaxf handle NaNs and end up as library calls
+static inline float minf(float a, float b) { return a < b ? a : b; }
+static inline float maxf(float a, float b) { return a > b ? a : b; }
+
+// Minimum and maximum over the periodic window n - r .. n - r + width - 1 for every
+// n, reading in[] and writing out[] with the given stride. van Herk / Gil-Werman:
+// the unrolled row is cut into blocks of width, g holds the running extreme from
+// each block start and h the one to each block end, so every window is h at its
+// first texel combined with g at its last -- three compares per texel for any r.
+static void windowMinMax(const float *lo, const float *hi, int stride, int N, int r, int width,
+                         float *out_lo, float *out_hi, float *window) {
+    const int mask = N - 1, length = N + width - 1;
+    float *glo = window, *ghi = window + length, *hlo = window + 2 * length, *hhi = window + 3 * length;
+
+    for (int b = 0; b < length; b += width) {
+        int e = b + width < length ? b + width : length;
+        for (int i = b; i < e; i++) {
+            int src = ((i - r) & mask) * stride;
+            glo[i] = i == b ? lo[src] : minf(glo[i - 1], lo[src]);
+            ghi[i] = i == b ? hi[src] : maxf(ghi[i - 1], hi[src]);
+        }
+        for (int i = e - 1; i >= b; i--) {
+            int src = ((i - r) & mask) * stride;
+            hlo[i] = i == e - 1 ? lo[src] : minf(hlo[i + 1], lo[src]);
+            hhi[i] = i == e - 1 ? hi[src] : maxf(hhi[i + 1], hi[src]);
+        }
+    }
+    for (int n = 0; n < N; n++) {
+        out_lo[n * stride] = minf(hlo[n], glo[n + width - 1]);
+        out_hi[n * stride] = maxf(hhi[n], ghi[n + width - 1]);
+    }
+}
+
+HeightPyramid::HeightPyramid(int N) :
+    N(N), levels(0), offsets(0), bounds(0), scratch(0), span(0), changed(0), window(0) {
+    for (int size = N; size > 0; size >>= 1) levels++;
+
+    offsets = new int[levels];
+    int total = 0;
+    for (int level = 0; level < levels; level++) {
+        offsets[level] = total;
+        total += 2 * (N >> level) * (N >> level);
+    }
+    bounds  = new float[total]();
+    scratch = new float[4 * N * N];
+    changed = new unsigned char[2 * N * N];
+    window  = new float[8 * N];
+}
+
+HeightPyramid::~HeightPyramid() {
+    if (offsets) delete [] offsets;
+    if (bounds)  delete [] bounds;
+    if (scratch) delete [] scratch;
+    if (span)    delete [] span;
+    if (changed) delete [] changed;
+    if (window)  delete [] window;
+}
+
+// dx and dz hold the horizontal displacement (in world units) of each texel. The
+// surface above a level 0 cell can come from any texel within max|D| of it, so the
+// level 0 bounds are taken over the cell dilated by that radius; the levels above
+// are plain unions of their four children. The dilation is separable, rows then
+// columns, each a sliding window min/max that costs the same for any radius.
+// Level 0 is recomputed in full, every texel moves between frames. The levels above
+// are updated incrementally: a cell is only recomputed if one of its children
+// changed, and the walk stops at the first level where nothing did -- calm parts of
+// the grid, or a build from the same frames, leave the coarse levels untouched.
+// With a second frame (height1, dx1, dz1) the bounds hold for every linear blend of
+// the two: a blended texel lies between its two heights and is displaced no further
+// than the larger of the two displacements.
+void HeightPyramid::build(const float *height, const float *dx, const float *dz, float texels_per_unit,
+                          const float *height1, const float *dx1, const float *dz1) {
+    float dmax = 0.0f;
+    for (int i = 0; i < N * N; i++) {
+        dmax = maxf(dmax, maxf(fabsf(dx[i]), fabsf(dz[i])));
+    }
+    const float *low = height, *high = height;
+    if (height1) {
+        for (int i = 0; i < N * N; i++) {
+            dmax = maxf(dmax, maxf(fabsf(dx1[i]), fabsf(dz1[i])));
+        }
+        if (!span) span = new float[2 * N * N];
+        for (int i = 0; i < N * N; i++) {
+            span[i]         = minf(height[i], height1[i]);
+            span[N * N + i] = maxf(height[i], height1[i]);
+        }
+        low  = span;
+        high = span + N * N;
+    }
+    int r     = (int)ceilf(dmax * texels_per_unit);
+    int width = 2 * r + 2;                  // texels n - r .. n + 1 + r
+    if (width > N) { r = 0; width = N; }
+
+    float *rmin = scratch, *rmax = scratch + N * N;
+    float *cmin = scratch + 2 * N * N, *cmax = scratch + 3 * N * N;
+    for (int m = 0; m < N; m++)
+        windowMinMax(low + m * N, high + m * N, 1, N, r, width, rmin + m * N, rmax + m * N, window);
+    for (int n = 0; n < N; n++)
+        windowMinMax(rmin + n, rmax + n, N, N, r, width, cmin + n, cmax + n, window);
+
+    float *level0 = bounds + offsets[0];
+    unsigned char *dirty = changed, *next = changed + N * N;
+    bool any = false;
+    for (int i = 0; i < N * N; i++) {
+        float *cell = level0 + 2 * i;
+        bool moved  = cell[0] != cmin[i] || cell[1] != cmax[i];
+        dirty[i] = moved;
+        any |= moved;
+        cell[0] = cmin[i];
+        cell[1] = cmax[i];
+    }
+
+    for (int level = 1; level < levels && any; level++) {
+        int size = N >> level;
+        const float *child = bounds + offsets[level - 1];
+        float *parent      = bounds + offsets[level];
+        any = false;
+        for (int m = 0; m < size; m++) {
+            const float *c0 = child + 2 * (2 * m)     * (2 * size);
+            const float *c1 = child + 2 * (2 * m + 1) * (2 * size);
+            const unsigned char *d0 = dirty + (2 * m) * (2 * size), *d1 = d0 + 2 * size;
+            for (int n = 0; n < size; n++) {
+                next[m * size + n] = 0;
+                if (!(d0[2 * n] | d0[2 * n + 1] | d1[2 * n] | d1[2 * n + 1])) continue;
+                float lo = minf(minf(c0[4 * n],     c0[4 * n + 2]), minf(c1[4 * n],     c1[4 * n + 2]));
+                float hi = maxf(maxf(c0[4 * n + 1], c0[4 * n + 3]), maxf(c1[4 * n + 1], c1[4 * n + 3]));
+                float *cell = parent + 2 * (m * size + n);
+                bool moved  = cell[0] != lo || cell[1] != hi;
+                next[m * size + n] = moved;
+                any |= moved;
+                cell[0] = lo;
+                cell[1] = hi;
+            }
+        }
+        unsigned char *swap = dirty;
+        dirty = next;
+        next  = swap;
+    }
+}
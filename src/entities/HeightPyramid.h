@@ -0,0 +1,34 @@
+#ifndef HEIGHTPYRAMID_H
+#define HEIGHTPYRAMID_H
+
+// min/max mip pyramid over a periodic N*N height grid.
+// level 0 has one cell per texel, every level above halves the resolution,
+// the top level is a single cell bounding the whole grid.
+class HeightPyramid {
+  private:
+    int N;                  // grid dimension -- power of 2
+    int levels;             // log2(N) + 1
+    int *offsets;           // start of each level in bounds
+    float *bounds;          // (min, max) pairs, all levels back to back
+    float *scratch;         // row and column pass of the dilation filter (4*N*N)
+    float *span;            // per texel (min, max) over two frames (2*N*N), allocated on first use
+    unsigned char *changed; // cells of a level whose bounds changed in this build (2*N*N)
+    float *window;          // running extremes of one line of the dilation (8*N)
+
+  protected:
+  public:
+    HeightPyramid(int N);
+    ~HeightPyramid();
+
+    void build(const float *height, const float *dx, const float *dz, float texels_per_unit,
+               const float *height1 = 0, const float *dx1 = 0, const float *dz1 = 0);
+
+    int levelCount() const { return levels; }
+    int levelSize(int level) const { return N >> level; }
+    const float* cell(int level, int n, int m) const {    // n and m wrap around
+        int mask = (N >> level) - 1;
+        return bounds + offsets[level] + 2 * ((m & mask) * (N >> level) + (n & mask));
+    }
+};
+
+#endif
@@ -0,0 +1,144 @@
+#include "OceanBake.h"
+#include "OceanSimulation.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+struct bake_header {
+    char magic[8];
+    uint32_t version;
+    int32_t N;
+    int32_t frames;
+    float fps;
+    float length;
+    uint32_t reserved[9];       // pads the header to 64 bytes
+};
+
+static const char bake_magic[8] = { 'W', 'E', 'T', 'B', 'A', 'K', 'E', 0 };
+static const uint32_t bake_version = 1;
+static const int bake_channels = 5;     // height, dx, dz, nx, nz
+
+// per frame: one scale per channel, then the channels one after another
+static size_t frameBytes(int N) {
+    return bake_channels * sizeof(float) + (size_t)bake_channels * N * N * sizeof(int16_t);
+}
+
+OceanBake::OceanBake() :
+    mapping(0), size(0), N(0), frame_count(0), fps(0.0f), length(0.0f), frames(0), frame_bytes(0) { }
+
+OceanBake::~OceanBake() {
+    if (mapping) munmap(mapping, size);
+}
+
+// evaluates the simulation over one full period, the frame after the last one is
+// frame 0 again
+bool OceanBake::record(OceanSimulation *simulation, const std::string &path, float fps) {
+    int N      = simulation->resolution();
+    int count  = (int)ceilf(simulation->repeatPeriod() * fps);
+    if (count < 1) return false;
+
+    bake_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, bake_magic, sizeof(bake_magic));
+    header.version = bake_version;
+    header.N       = N;
+    header.frames  = count;
+    header.fps     = count / simulation->repeatPeriod();
+    header.length  = simulation->patchLength();
+
+    std::string tmp = path + ".tmp";
+    FILE *f = fopen(tmp.c_str(), "wb");
+    if (!f) return false;
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+
+    std::vector<int16_t> quantized((size_t)bake_channels * N * N);
+    for (int frame = 0; frame < count && ok; frame++) {
+        simulation->evaluateWavesFFT(frame / header.fps);
+
+        const float *channels[bake_channels] = {
+            simulation->height(), simulation->displacementX(), simulation->displacementZ(),
+            simulation->normalX(), simulation->normalZ()
+        };
+        float scales[bake_channels];
+        for (int c = 0; c < bake_channels; c++) {
+            float peak = 0.0f;
+            for (int i = 0; i < N * N; i++) peak = fmaxf(peak, fabsf(channels[c][i]));
+            scales[c] = peak > 0.0f ? peak / 32767.0f : 1.0f;
+
+            int16_t *q = &quantized[(size_t)c * N * N];
+            for (int i = 0; i < N * N; i++) q[i] = (int16_t)lrintf(channels[c][i] / scales[c]);
+        }
+        ok = fwrite(scales, sizeof(float), bake_channels, f) == (size_t)bake_channels &&
+             fwrite(&quantized[0], sizeof(int16_t), quantized.size(), f) == quantized.size();
+    }
+    ok = (fclose(f) == 0) && ok;
+
+    if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+        remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool OceanBake::open(const std::string &path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    bake_header header;
+    if (fstat(fd, &st) != 0 || read(fd, &header, sizeof(header)) != (ssize_t)sizeof(header) ||
+        memcmp(header.magic, bake_magic, sizeof(bake_magic)) != 0 || header.version != bake_version ||
+        header.N <= 0 || (header.N & (header.N - 1)) != 0 || header.frames <= 0 ||
+        (size_t)st.st_size != sizeof(header) + header.frames * frameBytes(header.N)) {
+        close(fd);
+        return false;
+    }
+
+    void *p = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return false;
+    madvise(p, st.st_size, MADV_SEQUENTIAL);
+
+    if (mapping) munmap(mapping, size);
+    mapping     = p;
+    size        = st.st_size;
+    N           = header.N;
+    frame_count = header.frames;
+    fps         = header.fps;
+    length      = header.length;
+    frames      = (const char*)p + sizeof(header);
+    frame_bytes = frameBytes(N);
+    return true;
+}
+
+// linear interpolation between the two frames around t, wrapping at the period.
+// ny is rebuilt from the interpolated x and z components.
+void OceanBake::evaluate(float t, float *height, float *dx, float *dz,
+                         float *nx, float *ny, float *nz) const {
+    double position = fmod((double)t * fps, (double)frame_count);
+    if (position < 0.0) position += frame_count;
+    int f0 = (int)position;
+    if (f0 >= frame_count) f0 = 0;
+    int f1 = f0 + 1 < frame_count ? f0 + 1 : 0;
+    float s = (float)(position - f0);
+
+    const char *frame0 = frames + f0 * frame_bytes, *frame1 = frames + f1 * frame_bytes;
+    const float *scale0 = (const float*)frame0, *scale1 = (const float*)frame1;
+    const int16_t *q0 = (const int16_t*)(scale0 + bake_channels);
+    const int16_t *q1 = (const int16_t*)(scale1 + bake_channels);
+    float *channels[bake_channels] = { height, dx, dz, nx, nz };
+
+    int texels = N * N;
+    for (int c = 0; c < bake_channels; c++) {
+        float a = scale0[c] * (1.0f - s), b = scale1[c] * s;
+        const int16_t *c0 = q0 + c * texels, *c1 = q1 + c * texels;
+        float *out = channels[c];
+        for (int i = 0; i < texels; i++) out[i] = c0[i] * a + c1[i] * b;
+    }
+    for (int i = 0; i < texels; i++) ny[i] = sqrtf(fmaxf(0.0f, 1.0f - nx[i] * nx[i] - nz[i] * nz[i]));
+}
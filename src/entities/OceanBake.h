@@ -0,0 +1,40 @@
+#ifndef OCEANBAKE_H
+#define OCEANBAKE_H
+
+#include <string>
+#include <stdint.h>
+
+class OceanSimulation;
+
+// One repeat period of an OceanSimulation sampled at a fixed frame rate. Every
+// frame stores height, displacement and the x/z normal components as 16 bit
+// values with a per frame scale; the file is mapped and frames are decoded and
+// interpolated on demand, so playing it back costs a pass over two frames.
+class OceanBake {
+  private:
+    void *mapping;
+    size_t size;
+    int N;
+    int frame_count;
+    float fps;
+    float length;
+    const char *frames;         // first frame inside the mapping
+    size_t frame_bytes;
+
+  protected:
+  public:
+    OceanBake();
+    ~OceanBake();
+
+    static bool record(OceanSimulation *simulation, const std::string &path, float fps);
+
+    bool open(const std::string &path);
+    int resolution() const { return N; }
+    int frameCount() const { return frame_count; }
+    float frameRate() const { return fps; }
+    float patchLength() const { return length; }
+    void evaluate(float t, float *height, float *dx, float *dz,
+                  float *nx, float *ny, float *nz) const;
+};
+
+#endif
@@ -0,0 +1,115 @@
+#include "OceanIndices.h"
+#include <stdio.h>
+#include <vector>
+
+static const unsigned int restart = 0xFFFFFFFFu;
+
+// de-interleaves the even bits of a Morton code
+static unsigned int compact(unsigned int d) {
+    d &= 0x55555555;
+    d = (d | (d >> 1)) & 0x33333333;
+    d = (d | (d >> 2)) & 0x0F0F0F0F;
+    d = (d | (d >> 4)) & 0x00FF00FF;
+    d = (d | (d >> 8)) & 0x0000FFFF;
+    return d;
+}
+
+// two triangles of quad (n, m), same winding as a strip
+static void emitQuad(std::vector<unsigned int> &out, int Nplus1, int n, int m) {
+    unsigned int index = m * Nplus1 + n;
+    out.push_back(index);
+    out.push_back(index + Nplus1);
+    out.push_back(index + Nplus1 + 1);
+    out.push_back(index);
+    out.push_back(index + Nplus1 + 1);
+    out.push_back(index + 1);
+}
+
+// strip over the quads n0 .. n1 - 1 of row m
+static void emitStrip(std::vector<unsigned int> &out, int Nplus1, int m, int n0, int n1) {
+    if (!out.empty()) out.push_back(restart);
+    for (int n = n0; n <= n1; n++) {
+        out.push_back(m * Nplus1 + n);
+        out.push_back((m + 1) * Nplus1 + n);
+    }
+}
+
+OceanIndices::OceanIndices(int N, index_topology topology, index_order order, int block) :
+    N(N), Nplus1(N+1), topology(topology), wide(false), count(0), triangles(0), indices16(0), indices32(0)
+{
+    if (block < 1 || block > N) block = N;
+    while (N % block) block--;                  // tiles have to cover the grid
+    if (order == INDEX_ROWS) block = N;         // a single tile covering the grid
+    int blocks = N / block;
+    std::vector<unsigned int> out;
+    out.reserve(topology == INDEX_STRIPS ? N * blocks * (2 * block + 3) : 6 * N * N);
+
+    if (order == INDEX_MORTON && topology == INDEX_TRIANGLES) {
+        for (unsigned int d = 0; d < (unsigned int)(N * N); d++) emitQuad(out, Nplus1, compact(d), compact(d >> 1));
+    } else {
+        // tiles of block x block quads, row by row inside; strips may visit the tiles along a Z curve
+        for (int t = 0; t < blocks * blocks; t++) {
+            int bx = t % blocks, by = t / blocks;
+            if (order == INDEX_MORTON) {
+                bx = compact(t);
+                by = compact(t >> 1);
+            }
+            for (int m = by * block; m < (by + 1) * block; m++) {
+                if (topology == INDEX_STRIPS) {
+                    emitStrip(out, Nplus1, m, bx * block, (bx + 1) * block);
+                } else {
+                    for (int n = bx * block; n < (bx + 1) * block; n++) emitQuad(out, Nplus1, n, m);
+                }
+            }
+        }
+    }
+
+    count     = out.size();
+    triangles = 2 * N * N;
+    wide      = (unsigned int)(Nplus1 * Nplus1) > 0xFFFFu;     // 0xFFFF itself is the restart index
+    if (wide) {
+        indices32 = new unsigned int[count];
+        for (unsigned int i = 0; i < count; i++) indices32[i] = out[i];
+    } else {
+        indices16 = new unsigned short[count];
+        for (unsigned int i = 0; i < count; i++) indices16[i] = (unsigned short)out[i];
+    }
+}
+
+OceanIndices::~OceanIndices() {
+    if (indices16) delete [] indices16;
+    if (indices32) delete [] indices32;
+}
+
+// average cache miss ratio: vertices shaded per triangle with a FIFO post-transform
+// cache of cache_size entries, 0.5 is the limit for a regular grid, 3 means no reuse
+float OceanIndices::acmr(int cache_size) const {
+    std::vector<unsigned int> cache(cache_size, restart);
+    int head = 0;
+    unsigned int misses = 0;
+    for (unsigned int i = 0; i < count; i++) {
+        unsigned int v = index(i);
+        if (v == restartIndex()) continue;
+        bool hit = false;
+        for (int c = 0; c < cache_size && !hit; c++) hit = cache[c] == v;
+        if (hit) continue;
+        cache[head] = v;
+        head = (head + 1) % cache_size;
+        misses++;
+    }
+    return (float)misses / triangles;
+}
+
+// bytes and ACMR of every configuration for an N grid
+void OceanIndices::report(int N, int cache_size) {
+    const char *topologies[] = { "triangles", "strips" };
+    const char *orders[]     = { "rows", "blocks", "morton" };
+    printf("ocean indices, N = %d, FIFO cache of %d\n", N, cache_size);
+    for (int topology = 0; topology < 2; topology++) {
+        for (int order = 0; order < 3; order++) {
+            OceanIndices indices(N, (index_topology)topology, (index_order)order);
+            printf("  %-9s %-6s  %2d bit  %9lu bytes  ACMR %.3f\n", topologies[topology], orders[order],
+                   indices.wideIndices() ? 32 : 16, (unsigned long)indices.bytes(), indices.acmr(cache_size));
+        }
+    }
+}
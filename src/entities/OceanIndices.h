@@ -0,0 +1,50 @@
+#ifndef OCEANINDICES_H
+#define OCEANINDICES_H
+
+#include <stddef.h>
+
+enum index_topology {
+    INDEX_TRIANGLES,            // two triangles per quad
+    INDEX_STRIPS                // one strip per row of quads, strips separated by a restart index
+};
+
+enum index_order {
+    INDEX_ROWS,                 // quads row by row across the whole grid
+    INDEX_BLOCKS,               // block x block tiles, row by row inside each
+    INDEX_MORTON                // quads (lists) or tiles (strips) along a Z curve
+};
+
+
+
+
+// Index buffer for the (N+1)*(N+1) vertex grid of an ocean tile. Indices are 16 bit
+// whenever the vertex count leaves room for the restart index, 32 bit otherwise.
+// The triangles wind the same way in every configuration.
+class OceanIndices {
+  private:
+    int N, Nplus1;
+    index_topology topology;
+    bool wide;                  // 32 bit indices
+    unsigned int count;         // indices, restart indices included
+    unsigned int triangles;
+    unsigned short *indices16;
+    unsigned int *indices32;
+
+  protected:
+  public:
+    OceanIndices(int N, index_topology topology, index_order order, int block = 8);
+    ~OceanIndices();
+
+    bool wideIndices() const { return wide; }
+    const void* data() const { return wide ? (const void *)indices32 : (const void *)indices16; }
+    unsigned int indexCount() const { return count; }
+    unsigned int triangleCount() const { return triangles; }
+    size_t bytes() const { return (size_t)count * (wide ? 4 : 2); }
+    unsigned int restartIndex() const { return wide ? 0xFFFFFFFFu : 0xFFFFu; }
+    unsigned int index(unsigned int i) const { return wide ? indices32[i] : indices16[i]; }
+
+    float acmr(int cache_size = 24) const;
+    static void report(int N, int cache_size = 24);
+};
+
+#endif
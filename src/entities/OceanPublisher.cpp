@@ -0,0 +1,248 @@
+#include "OceanPublisher.h"
+#include "OceanSimulation.h"
+#include <string.h>
+#include <errno.h>
+#include <atomic>
+#include <new>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// The segment is a header followed by slots of slot_bytes each: a 64 byte slot header
+// and the six N*N float channels height, dx, dz, nx, ny, nz.
+struct shm_header {
+    char magic[8];
+    uint32_t version;
+    int32_t N;
+    int32_t slots;
+    uint32_t reserved0;
+    uint64_t slot_bytes;
+    std::atomic<uint64_t> latest;   // number of the newest complete frame
+    uint32_t reserved[6];           // pads the header to 64 bytes
+};
+
+struct shm_slot {
+    std::atomic<uint32_t> sequence; // odd while the slot is being written
+    float time;
+    uint64_t number;
+    float length;
+    uint32_t reserved[11];          // pads the slot header to 64 bytes
+};
+
+static const char shm_magic[8] = { 'W', 'E', 'T', 'S', 'H', 'M', 0, 0 };
+static const uint32_t shm_version = 1;
+static const int shm_channels = 6;
+static const int shm_max_N = 8192;      // 1.5 GiB per slot, keeps every size below in range
+
+static bool validResolution(int N) {
+    return N > 0 && N <= shm_max_N && (N & (N - 1)) == 0;
+}
+
+static size_t slotBytes(int N) {
+    size_t bytes = sizeof(shm_slot) + (size_t)shm_channels * N * N * sizeof(float);
+    return (bytes + 63) & ~(size_t)63;
+}
+
+static inline const float* channel(const shm_slot *slot, int N, int c) {
+    return (const float *)(slot + 1) + (size_t)c * N * N;
+}
+
+OceanPublisher::OceanPublisher() :
+    mapping(0), size(0), N(0), slots(0), slot_bytes(0), frame_count(0) { }
+
+OceanPublisher::~OceanPublisher() {
+    close();
+}
+
+// Creates the segment /name; fails with EEXIST if it is there already, so two
+// publishers never write into one ring. A segment left behind by a publisher that
+// died goes with shm_unlink (rm /dev/shm/name). The magic is written last, a
+// subscriber that opens the segment before that sees no valid header.
+bool OceanPublisher::create(const std::string &segment, int resolution, int slot_count) {
+    close();
+    if (!validResolution(resolution) || slot_count < 1) {
+        errno = EINVAL;
+        return false;
+    }
+
+    int fd = shm_open(segment.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) return false;
+
+    slot_bytes = slotBytes(resolution);
+    size = sizeof(shm_header) + slot_count * slot_bytes;
+    if (ftruncate(fd, size) != 0) {
+        ::close(fd);
+        shm_unlink(segment.c_str());
+        return false;
+    }
+    void *p = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        shm_unlink(segment.c_str());
+        return false;
+    }
+
+    name        = segment;
+    mapping     = p;
+    N           = resolution;
+    slots       = slot_count;
+    frame_count = 0;
+
+    memset(mapping, 0, size);
+    shm_header *header = new (mapping) shm_header;
+    header->version    = shm_version;
+    header->N          = N;
+    header->slots      = slots;
+    header->slot_bytes = slot_bytes;
+    header->latest.store(0, std::memory_order_relaxed);
+    for (int i = 0; i < slots; i++)
+        new ((char *)mapping + sizeof(shm_header) + i * slot_bytes) shm_slot;
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(header->magic, shm_magic, sizeof(shm_magic));
+    return true;
+}
+
+void OceanPublisher::close() {
+    if (!mapping) return;
+    munmap(mapping, size);
+    shm_unlink(name.c_str());
+    mapping = 0;
+}
+
+void OceanPublisher::publish(const OceanSimulation *simulation, float t) {
+    publish(t, simulation->patchLength(), simulation->height(),
+            simulation->displacementX(), simulation->displacementZ(),
+            simulation->normalX(), simulation->normalY(), simulation->normalZ());
+}
+
+// Round robin over the slots. Readers get slots - 1 frames of time to finish with
+// one before it is overwritten, and can tell if they did not.
+void OceanPublisher::publish(float t, float length, const float *height, const float *dx, const float *dz,
+                             const float *nx, const float *ny, const float *nz) {
+    if (!mapping) return;
+
+    uint64_t number = ++frame_count;
+    shm_header *header = (shm_header *)mapping;
+    shm_slot *slot = (shm_slot *)((char *)mapping + sizeof(shm_header) + (number % slots) * slot_bytes);
+    float *data = (float *)(slot + 1);
+    size_t bytes = (size_t)N * N * sizeof(float);
+
+    uint32_t sequence = slot->sequence.load(std::memory_order_relaxed);
+    slot->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot->time   = t;
+    slot->number = number;
+    slot->length = length;
+    memcpy(data,                 height, bytes);
+    memcpy(data + (size_t)N * N,     dx, bytes);
+    memcpy(data + (size_t)2 * N * N, dz, bytes);
+    memcpy(data + (size_t)3 * N * N, nx, bytes);
+    memcpy(data + (size_t)4 * N * N, ny, bytes);
+    memcpy(data + (size_t)5 * N * N, nz, bytes);
+
+    slot->sequence.store(sequence + 2, std::memory_order_release);
+    header->latest.store(number, std::memory_order_release);
+}
+
+
+OceanSubscriber::OceanSubscriber() :
+    mapping(0), size(0), header(0), N(0), slots(0), slot_bytes(0) { }
+
+OceanSubscriber::~OceanSubscriber() {
+    if (mapping) munmap(mapping, size);
+}
+
+bool OceanSubscriber::open(const std::string &segment) {
+    int fd = shm_open(segment.c_str(), O_RDONLY, 0);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(shm_header)) {
+        ::close(fd);
+        return false;
+    }
+    void *p = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) return false;
+
+    // N is bounded before slotBytes() multiplies with it and slots by the file size
+    // before it is multiplied in turn, whatever the header holds
+    const shm_header *h = (const shm_header *)p;
+    bool ok = memcmp(h->magic, shm_magic, sizeof(shm_magic)) == 0 && h->version == shm_version &&
+              validResolution(h->N) && h->slot_bytes == slotBytes(h->N) &&
+              h->slots > 0 && (uint64_t)h->slots <= ((size_t)st.st_size - sizeof(shm_header)) / h->slot_bytes;
+    if (!ok) {
+        munmap(p, st.st_size);
+        return false;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    if (mapping) munmap(mapping, size);
+    mapping    = p;
+    size       = st.st_size;
+    header     = h;
+    N          = h->N;
+    slots      = h->slots;
+    slot_bytes = h->slot_bytes;
+    return true;
+}
+
+const shm_slot* OceanSubscriber::slotAt(int slot) const {
+    return (const shm_slot *)((const char *)mapping + sizeof(shm_header) + slot * slot_bytes);
+}
+
+uint64_t OceanSubscriber::latest() const {
+    return header ? header->latest.load(std::memory_order_acquire) : 0;
+}
+
+// Points frame at the newest slot. Retries while that slot is mid write, which only
+// happens if the publisher lapped the whole ring since latest was read.
+bool OceanSubscriber::acquire(ocean_shm_frame &frame) const {
+    for (;;) {
+        uint64_t number = latest();
+        if (!number) return false;
+
+        int index = number % slots;
+        const shm_slot *slot = slotAt(index);
+        uint32_t sequence = slot->sequence.load(std::memory_order_acquire);
+        if (sequence & 1) continue;
+
+        frame.number   = slot->number;
+        frame.time     = slot->time;
+        frame.length   = slot->length;
+        frame.height   = channel(slot, N, 0);
+        frame.dx       = channel(slot, N, 1);
+        frame.dz       = channel(slot, N, 2);
+        frame.nx       = channel(slot, N, 3);
+        frame.ny       = channel(slot, N, 4);
+        frame.nz       = channel(slot, N, 5);
+        frame.sequence = sequence;
+        frame.slot     = index;
+        if (valid(frame)) return true;
+    }
+}
+
+bool OceanSubscriber::valid(const ocean_shm_frame &frame) const {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slotAt(frame.slot)->sequence.load(std::memory_order_relaxed) == frame.sequence;
+}
+
+bool OceanSubscriber::read(float &t, float &length, float *height, float *dx, float *dz,
+                           float *nx, float *ny, float *nz) const {
+    size_t bytes = (size_t)N * N * sizeof(float);
+    ocean_shm_frame frame;
+    do {
+        if (!acquire(frame)) return false;
+        t      = frame.time;
+        length = frame.length;
+        memcpy(height, frame.height, bytes);
+        memcpy(dx,     frame.dx,     bytes);
+        memcpy(dz,     frame.dz,     bytes);
+        memcpy(nx,     frame.nx,     bytes);
+        memcpy(ny,     frame.ny,     bytes);
+        memcpy(nz,     frame.nz,     bytes);
+    } while (!valid(frame));
+    return true;
+}
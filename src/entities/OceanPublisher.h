@@ -0,0 +1,78 @@
+#ifndef OCEANPUBLISHER_H
+#define OCEANPUBLISHER_H
+
+#include <string>
+#include <stdint.h>
+
+class OceanSimulation;
+struct shm_header;
+struct shm_slot;
+
+// Pointers into one published frame, straight into the shared mapping. They stay
+// readable while the slot is rewritten, OceanSubscriber::valid() tells afterwards
+// whether what was read is consistent.
+struct ocean_shm_frame {
+    uint64_t number;            // 1 for the first frame published
+    float time;                 // simulation time it was evaluated at
+    float length;               // patch length at that time
+    const float *height, *dx, *dz, *nx, *ny, *nz;   // N*N each
+    uint32_t sequence;          // slot sequence seen when acquired
+    int slot;
+};
+
+// Writes every frame an OceanSimulation evaluates into a POSIX shared memory ring
+// of a few slots, so other processes on the machine can read the current surface
+// without running a simulation of their own. Each slot is guarded by a sequence
+// lock: odd while being written, bumped to the next even value when done. The
+// header holds the number of the newest complete frame.
+class OceanPublisher {
+  private:
+    std::string name;
+    void *mapping;
+    size_t size;
+    int N;
+    int slots;
+    size_t slot_bytes;
+    uint64_t frame_count;
+
+  protected:
+  public:
+    OceanPublisher();
+    ~OceanPublisher();      // unmaps and removes the segment
+
+    bool create(const std::string &name, int N, int slots = 4);
+    void publish(const OceanSimulation *simulation, float t);
+    void publish(float t, float length, const float *height, const float *dx, const float *dz,
+                 const float *nx, const float *ny, const float *nz);
+    void close();
+    int resolution() const { return N; }
+};
+
+// Read only view of a segment made by OceanPublisher.
+class OceanSubscriber {
+  private:
+    void *mapping;
+    size_t size;
+    const shm_header *header;
+    int N;
+    int slots;
+    size_t slot_bytes;
+
+    const shm_slot* slotAt(int slot) const;
+
+  protected:
+  public:
+    OceanSubscriber();
+    ~OceanSubscriber();
+
+    bool open(const std::string &name);
+    int resolution() const { return N; }
+    uint64_t latest() const;        // number of the newest complete frame, 0 if none yet
+
+    bool acquire(ocean_shm_frame &frame) const;     // newest frame, false if none
+    bool valid(const ocean_shm_frame &frame) const; // the slot was not rewritten since acquire
+    bool read(float &t, float &length, float *height, float *dx, float *dz,
+              float *nx, float *ny, float *nz) const;   // consistent copy of the newest frame
+};
+
+#endif
@@ -0,0 +1,157 @@
+#include "OceanRenderer.h"
+#include "Trace.h"
+
+// The line grid (geometry) keeps a plain 32 bit line list. The surface takes its
+// indices from OceanIndices in the given topology and order; they live in the
+// element buffer only.
+OceanRenderer::OceanRenderer(const OceanSimulation *simulation, const bool geometry,
+                             index_topology topology, index_order order) :
+    simulation(simulation), geometry(geometry),
+    N(simulation->resolution()), Nplus1(N+1), length(simulation->patchLength()),
+    indices(0), vertices(0), arena(0),
+    primitive(GL_LINES), index_type(GL_UNSIGNED_INT), restart_index(0), restart(false)
+{
+    // the line grid has three lines per quad plus the closing edges of the last row and column
+    unsigned int line_indices = geometry ? 6 * N * N + 4 * N : 0;
+    arena          = new Arena(Arena::blockSize(sizeof(vertex_ocean) * Nplus1*Nplus1) +
+                               Arena::blockSize(sizeof(unsigned int) * line_indices),
+                               simulation->pageBacking());
+    vertices       = arena->take<vertex_ocean>(Nplus1*Nplus1);
+
+    const void *index_data;
+    size_t index_bytes;
+    OceanIndices *surface = 0;
+    if (geometry) {
+        indices = arena->take<unsigned int>(line_indices);
+
+        int index;
+
+        indices_count = 0;
+        for (int m_prime = 0; m_prime < N; m_prime++) {
+            for (int n_prime = 0; n_prime < N; n_prime++) {
+                index = m_prime * Nplus1 + n_prime;
+
+                indices[indices_count++] = index;               // lines
+                indices[indices_count++] = index + 1;
+                indices[indices_count++] = index;
+                indices[indices_count++] = index + Nplus1;
+                indices[indices_count++] = index;
+                indices[indices_count++] = index + Nplus1 + 1;
+                if (n_prime == N - 1) {
+                    indices[indices_count++] = index + 1;
+                    indices[indices_count++] = index + Nplus1 + 1;
+                }
+                if (m_prime == N - 1) {
+                    indices[indices_count++] = index + Nplus1;
+                    indices[indices_count++] = index + Nplus1 + 1;
+                }
+            }
+        }
+        index_data  = indices;
+        index_bytes = indices_count * sizeof(unsigned int);
+    } else {
+        surface       = new OceanIndices(N, topology, order);
+        primitive     = topology == INDEX_STRIPS ? GL_TRIANGLE_STRIP : GL_TRIANGLES;
+        index_type    = surface->wideIndices() ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;
+        restart_index = surface->restartIndex();
+        restart       = topology == INDEX_STRIPS;
+        indices_count = surface->indexCount();
+        index_data    = surface->data();
+        index_bytes   = surface->bytes();
+    }
+
+    update();
+
+    glGenVertexArrays(1, &vao);
+    // bind the VAO
+    glBindVertexArray(vao);
+
+
+    glGenBuffers(1, &vbo_vertices);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_vertices);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertex_ocean)*(Nplus1)*(Nplus1), vertices, GL_DYNAMIC_DRAW);
+
+    glGenBuffers(1, &vbo_indices);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbo_indices);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_bytes, index_data, GL_STATIC_DRAW);
+
+    glBindVertexArray(0);
+
+    if (surface) delete surface;
+}
+
+void OceanRenderer::enableAttribs(GLint vertex, GLint normal){
+    glBindVertexArray(vao);
+    glEnableVertexAttribArray(vertex);
+    glVertexAttribPointer(vertex, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_ocean), 0);
+    
+    glEnableVertexAttribArray(normal);
+    glVertexAttribPointer(normal, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_ocean), (char *)NULL + 12);
+
+    glBindVertexArray(0);
+}
+
+OceanRenderer::~OceanRenderer() {
+    if (arena)          delete arena;      // vertices and indices
+}
+
+void OceanRenderer::release() {
+    glDeleteBuffers(1, &vbo_indices);
+    glDeleteBuffers(1, &vbo_vertices);
+    glDeleteVertexArrays(1, &vao);
+}
+
+// copies the last simulation frame into the vertex array, wrapping around for the
+// last row and column
+void OceanRenderer::update() {
+    TRACE_ZONE("OceanRenderer::update");
+    const float *height = simulation->height();
+    const float *dx = simulation->displacementX(), *dz = simulation->displacementZ();
+    const float *nx = simulation->normalX(), *ny = simulation->normalY(), *nz = simulation->normalZ();
+    int mask = N - 1;
+    length = simulation->patchLength();     // can change under a running simulation
+
+    for (int m_prime = 0; m_prime < Nplus1; m_prime++) {
+        float oz = (m_prime - N / 2.0f) * length / N;
+        for (int n_prime = 0; n_prime < Nplus1; n_prime++) {
+            float ox = (n_prime - N / 2.0f) * length / N;
+            int index  = (m_prime & mask) * N + (n_prime & mask);
+            vertex_ocean &v = vertices[m_prime * Nplus1 + n_prime];
+
+            v.x  = ox + dx[index];
+            v.y  = height[index];
+            v.z  = oz + dz[index];
+            v.nx = nx[index];
+            v.ny = ny[index];
+            v.nz = nz[index];
+        }
+    }
+}
+
+void OceanRenderer::render(ogl::Program* oceanShader) {
+    TRACE_ZONE("OceanRenderer::render");
+    glm::mat4 model = glm::mat4(1.0f);
+
+    update();
+
+    glBindVertexArray(vao);
+
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_vertices);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertex_ocean) * Nplus1 * Nplus1, vertices);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbo_indices);
+    if (restart) {
+        glEnable(GL_PRIMITIVE_RESTART);
+        glPrimitiveRestartIndex(restart_index);
+    }
+    for (int j = 0; j < 10; j++) {
+        for (int i = 0; i < 10; i++) {
+            model = glm::scale(glm::mat4(1.0f), glm::vec3(5.f,5.f,5.f));
+            model = glm::translate(model, glm::vec3(length * i, 0, length * -j));
+            oceanShader->setUniform("model", model);
+            glDrawElements(primitive, indices_count, index_type, 0);
+        }
+    }
+    if (restart) glDisable(GL_PRIMITIVE_RESTART);
+    glBindVertexArray(0);
+}
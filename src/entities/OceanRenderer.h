@@ -0,0 +1,51 @@
+#ifndef OCEANRENDERER_H
+#define OCEANRENDERER_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include "../ogl/Program.h"
+#include "OceanSimulation.h"
+#include "OceanIndices.h"
+
+
+struct vertex_ocean {
+    GLfloat   x,   y,   z; // vertex
+    GLfloat  nx,  ny,  nz; // normal
+};
+
+
+
+
+// Draws the last frame of an OceanSimulation as a (N+1)*(N+1) grid, tiled 10x10.
+// The extra row and column repeat the first ones so neighbouring tiles meet.
+class OceanRenderer {
+  private:
+    const OceanSimulation *simulation;
+    bool geometry;              // flag to render geometry or surface
+    int N, Nplus1;              // dimension of the simulation
+    float length;               // length of one tile
+    unsigned int *indices;          // line grid indices, the surface ones only live in vbo_indices
+    unsigned int indices_count;     // number of indices to render
+    vertex_ocean *vertices;         // vertices for vertex buffer object
+    Arena *arena;                   // holds vertices and line indices
+    GLenum primitive, index_type;   // how vbo_indices is drawn
+    GLuint restart_index;
+    bool restart;                   // strips, separated by restart_index
+    GLuint vbo_vertices, vbo_indices, vao;   // vertex buffer objects
+
+  protected:
+  public:
+    OceanRenderer(const OceanSimulation *simulation, bool geometry,
+                  index_topology topology = INDEX_STRIPS, index_order order = INDEX_BLOCKS);
+    ~OceanRenderer();
+    void release();
+
+    void enableAttribs(GLint vertex, GLint normal);
+    void update();
+    void render(ogl::Program* shader);
+};
+
+
+#endif
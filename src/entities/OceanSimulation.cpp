@@ -0,0 +1,1574 @@
+#include "OceanSimulation.h"
+#include "Philox.h"
+#include "Parallel.h"
+#include "PerfCounters.h"
+#include "Trace.h"
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <stdio.h>
+#include <string.h>
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// standard normal pair for draw `stream` of texel (n_prime, m_prime), Marsaglia's polar
+// method on a Philox stream keyed by the seed -- every texel can be drawn on its own
+// and the result depends on nothing but these arguments
+complex gaussianRandomVariable(uint64_t seed, int n_prime, int m_prime, unsigned int stream) {
+    uint32_t key[2]     = { (uint32_t)seed, (uint32_t)(seed >> 32) };
+    uint32_t counter[4] = { (uint32_t)n_prime, (uint32_t)m_prime, stream, 0 };
+    uint32_t r[4];
+    float x1, x2, w;
+    for (;;) {
+        philox4x32(counter, key, r);
+        counter[3]++;
+        for (int i = 0; i < 4; i += 2) {
+            x1 = 2.f * philoxUniform(r[i])     - 1.f;
+            x2 = 2.f * philoxUniform(r[i + 1]) - 1.f;
+            w = x1 * x1 + x2 * x2;
+            if (w < 1.f && w > 0.f) {
+                w = sqrt((-2.f * log(w)) / w);
+                return complex(x1 * w, x2 * w);
+            }
+        }
+    }
+}
+
+// cache_dir, if given, is where the initial spectrum is baked to and loaded from.
+// The FFT buffers, the output grids and (unless they come from the cache) the
+// spectrum tables share one 64-byte aligned arena backed by pages.
+OceanSimulation::OceanSimulation(const int N, const float A, const vector2 w, const float length,
+                                 const uint64_t seed, const char *cache_dir, arena_pages pages) :
+    g(9.81), N(N), Nplus1(N+1), A(A), w(w), length(length), seed(seed), arena(0),
+    h0_tk(0), h0_tmk_conj(0), omega(0), spectrum(0), base_h0(0), gaussians(0), h_tilde(0), h_tilde_slopex(0), h_tilde_slopez(0), h_tilde_dx(0), h_tilde_dz(0),
+    out_height(0), out_dx(0), out_dz(0), out_nx(0), out_ny(0), out_nz(0), pyramid(0), pyramid_dirty(false),
+    playback(0), publisher(0), normal_mode(OCEAN_NORMALS_FFT), prune_mask(0), prune_rows(0), prune_threshold(0.0f), detail(0.0f),
+    step(0.0f), frame_index(0), frames_valid(false),
+    wave_model(OCEAN_WAVES_FFT), gerstner_count(0), gerstner_waves(0), gerstner_basis(0)
+{
+    for (int c = 0; c < 5; c++) lod_tilde[0][c] = lod_tilde[1][c] = 0;
+    for (int c = 0; c < 6; c++) frames[0][c] = frames[1][c] = 0;
+
+    spectrum_key key;
+    key.N      = N;
+    key.A      = A;
+    key.wx     = w.x;
+    key.wz     = w.y;
+    key.length = length;
+    key.g      = g;
+    key.seed   = seed;
+    std::string cache_file = cache_dir ? SpectrumCache::fileName(cache_dir, key) : "";
+
+    spectrum = new SpectrumCache();
+    if (!cache_dir || !spectrum->map(cache_file, key)) {
+        delete spectrum;
+        spectrum = 0;
+    }
+
+    size_t bytes = 5 * Arena::blockSize(sizeof(complex) * N*N) + 6 * Arena::blockSize(sizeof(float) * N*N);
+    if (!spectrum) {
+        bytes += 2 * Arena::blockSize(sizeof(complex) * Nplus1*Nplus1) + Arena::blockSize(sizeof(float) * Nplus1*Nplus1);
+    }
+    arena = new Arena(bytes, pages);
+
+    h_tilde        = arena->take<complex>(N*N);
+    h_tilde_slopex = arena->take<complex>(N*N);
+    h_tilde_slopez = arena->take<complex>(N*N);
+    h_tilde_dx     = arena->take<complex>(N*N);
+    h_tilde_dz     = arena->take<complex>(N*N);
+    out_height     = arena->take<float>(N*N);
+    out_dx         = arena->take<float>(N*N);
+    out_dz         = arena->take<float>(N*N);
+    out_nx         = arena->take<float>(N*N);
+    out_ny         = arena->take<float>(N*N);
+    out_nz         = arena->take<float>(N*N);
+    pyramid        = new HeightPyramid(N);
+    for (int c = 0; c < 6; c++) pyramid_source[c] = 0;
+
+    for (int index = 0; index < N*N; index++) out_ny[index] = 1.0f;
+    setPruneThreshold(0.0f);
+
+    if (spectrum) {
+        h0_tk       = spectrum->h0;
+        h0_tmk_conj = spectrum->h0mk_conj;
+        omega       = spectrum->omega;
+    } else {
+        h0_tk       = arena->take<complex>(Nplus1*Nplus1);
+        h0_tmk_conj = arena->take<complex>(Nplus1*Nplus1);
+        omega       = arena->take<float>(Nplus1*Nplus1);
+
+        Parallel::forEach(0, Nplus1, [this](int begin, int end) {
+            for (int m_prime = begin; m_prime < end; m_prime++) {
+                for (int n_prime = 0; n_prime < Nplus1; n_prime++) {
+                    int index = m_prime * Nplus1 + n_prime;
+
+                    h0_tk[index]       = hTilde_0( n_prime,  m_prime);
+                    h0_tmk_conj[index] = hTilde_0(-n_prime, -m_prime, 1).conj();
+                    omega[index]       = dispersion(n_prime, m_prime);
+                }
+            }
+        });
+
+        if (cache_dir) SpectrumCache::write(cache_file, key, h0_tk, h0_tmk_conj, omega);
+    }
+}
+
+OceanSimulation::~OceanSimulation() {
+    if (spectrum)       delete spectrum;
+    for (int level = 0; level < 3; level++) {
+        for (size_t i = 0; i < ffts[level].size(); i++) delete ffts[level][i];
+    }
+    if (pyramid)        delete pyramid;
+    if (prune_mask)     delete [] prune_mask;
+    if (prune_rows)     delete [] prune_rows;
+    for (int level = 0; level < 2; level++) {
+        for (int c = 0; c < 5; c++) if (lod_tilde[level][c]) delete [] lod_tilde[level][c];
+    }
+    for (int f = 0; f < 2; f++) {
+        for (int c = 0; c < 6; c++) if (frames[f][c]) delete [] frames[f][c];
+    }
+    if (gerstner_waves) delete [] gerstner_waves;
+    if (gerstner_basis) delete [] gerstner_basis;
+    if (base_h0)        delete [] base_h0;
+    if (gaussians)      delete [] gaussians;
+    for (size_t l = 0; l < layer_h0.size(); l++) delete [] layer_h0[l];
+    if (arena)          delete arena;      // spectrum tables, FFT buffers and output grids
+}
+
+float OceanSimulation::dispersion(int n_prime, int m_prime) {
+    float w_0 = 2.0f * M_PI / repeatPeriod();
+    float kx = M_PI * (2 * n_prime - N) / length;
+    float kz = M_PI * (2 * m_prime - N) / length;
+    return floor(sqrt(g * sqrt(kx * kx + kz * kz)) / w_0) * w_0;
+}
+
+ocean_layer OceanSimulation::baseLayer() const {
+    ocean_layer layer;
+    layer.A         = A;
+    layer.w         = w;
+    layer.damping   = 0.001f;
+    layer.spreading = 6;
+    return layer;
+}
+
+float OceanSimulation::phillips(int n_prime, int m_prime) {
+    return phillips(n_prime, m_prime, baseLayer());
+}
+
+float OceanSimulation::phillips(int n_prime, int m_prime, const ocean_layer &layer) {
+    vector2 k(M_PI * (2 * n_prime - N) / length,
+          M_PI * (2 * m_prime - N) / length);
+    float k_length  = k.length();
+    if (k_length < 0.000001) return 0.0;
+
+    float k_length2 = k_length  * k_length;
+    float k_length4 = k_length2 * k_length2;
+
+    vector2 wind    = layer.w;
+    float k_dot_w   = k.unit() * wind.unit();
+    float k_dot_wn  = 1.0f;
+    for (int i = 0; i < layer.spreading; i++) k_dot_wn *= k_dot_w;
+
+    float w_length  = wind.length();
+    float L         = w_length * w_length / g;
+    float L2        = L * L;
+    
+    float damping   = layer.damping;
+    float l2        = L2 * damping * damping;
+
+    return layer.A * exp(-1.0f / (k_length2 * L2)) / k_length4 * k_dot_wn * exp(-k_length2 * l2);
+}
+
+complex OceanSimulation::hTilde_0(int n_prime, int m_prime, unsigned int stream) {
+    return hTilde_0(n_prime, m_prime, stream, baseLayer());
+}
+
+complex OceanSimulation::hTilde_0(int n_prime, int m_prime, unsigned int stream, const ocean_layer &layer) {
+    complex r = gaussianRandomVariable(seed, n_prime, m_prime, stream);
+    return r * sqrt(phillips(n_prime, m_prime, layer) / 2.0f);
+}
+
+// Adds a spectrum layer with its own amplitude, wind and damping, e.g. a swell under
+// the local wind sea. Every layer shares the dispersion, so h~(k, t) is linear in the
+// summed h0 and the layers are added up once here, not per frame: the FFT cost is
+// the same for any number of layers. Layer l draws its own Gaussians from streams
+// 2 + 2l and 3 + 2l. Returns the index of the layer.
+int OceanSimulation::addLayer(const ocean_layer &layer) {
+    const int size = Nplus1 * Nplus1;
+    if (!base_h0) {
+        base_h0 = new complex[2 * size];
+        std::copy(h0_tk, h0_tk + size, base_h0);
+        std::copy(h0_tmk_conj, h0_tmk_conj + size, base_h0 + size);
+    }
+
+    complex *h0 = new complex[2 * size];
+    layers.push_back(layer);
+    layer_h0.push_back(h0);
+    fillLayer(layers.size() - 1);
+
+    combineLayers();
+    return (int)layers.size() - 1;
+}
+
+// draws the h0 and h0mk* tables of extra layer l
+void OceanSimulation::fillLayer(int l) {
+    const int size = Nplus1 * Nplus1;
+    unsigned int stream = 2 + 2 * l;
+    complex *h0 = layer_h0[l];
+    const ocean_layer &layer = layers[l];
+    Parallel::forEach(0, Nplus1, [this, h0, size, stream, &layer](int begin, int end) {
+        for (int m_prime = begin; m_prime < end; m_prime++) {
+            for (int n_prime = 0; n_prime < Nplus1; n_prime++) {
+                int index = m_prime * Nplus1 + n_prime;
+                h0[index]        = hTilde_0( n_prime,  m_prime, stream, layer);
+                h0[size + index] = hTilde_0(-n_prime, -m_prime, stream + 1, layer).conj();
+            }
+        }
+    });
+}
+
+bool OceanSimulation::setLayer(int index, const ocean_layer &layer) {
+    if (index < 0 || index >= (int)layers.size()) return false;
+    layers[index] = layer;
+    fillLayer(index);
+    combineLayers();
+    return true;
+}
+
+// The setters below change the spectrum in place, nothing else is rebuilt. The
+// Gaussian draws of the base layer are kept after the first change, so a new wind or
+// amplitude is one Phillips evaluation per bin, spread over the worker threads. A new
+// length also changes every k, so it recomputes the dispersion and redraws the extra
+// layers. The result is the same as constructing with the new parameters.
+void OceanSimulation::setWind(const vector2 wind) {
+    w = wind;
+    rescaleSpectrum(false);
+}
+
+void OceanSimulation::setAmplitude(const float amplitude) {
+    A = amplitude;
+    rescaleSpectrum(false);
+}
+
+void OceanSimulation::setLength(const float patch_length) {
+    length = patch_length;
+    rescaleSpectrum(true);
+}
+
+void OceanSimulation::rescaleSpectrum(bool dispersion_changed) {
+    const int size = Nplus1 * Nplus1;
+    if (!gaussians) {
+        gaussians = new complex[2 * size];
+        Parallel::forEach(0, Nplus1, [this, size](int begin, int end) {
+            for (int m_prime = begin; m_prime < end; m_prime++) {
+                for (int n_prime = 0; n_prime < Nplus1; n_prime++) {
+                    int index = m_prime * Nplus1 + n_prime;
+                    gaussians[index]        = gaussianRandomVariable(seed,  n_prime,  m_prime, 0);
+                    gaussians[size + index] = gaussianRandomVariable(seed, -n_prime, -m_prime, 1);
+                }
+            }
+        });
+    }
+
+    // with layers the base spectrum lives in base_h0 and h0_tk holds the sum
+    complex *h0   = base_h0 ? base_h0        : h0_tk;
+    complex *h0mk = base_h0 ? base_h0 + size : h0_tmk_conj;
+    ocean_layer layer = baseLayer();
+    Parallel::forEach(0, Nplus1, [this, h0, h0mk, size, &layer, dispersion_changed](int begin, int end) {
+        for (int m_prime = begin; m_prime < end; m_prime++) {
+            for (int n_prime = 0; n_prime < Nplus1; n_prime++) {
+                int index = m_prime * Nplus1 + n_prime;
+                h0[index]   = gaussians[index] * sqrt(phillips(n_prime, m_prime, layer) / 2.0f);
+                h0mk[index] = (gaussians[size + index] * sqrt(phillips(-n_prime, -m_prime, layer) / 2.0f)).conj();
+                if (dispersion_changed) omega[index] = dispersion(n_prime, m_prime);
+            }
+        }
+    });
+
+    if (dispersion_changed) {
+        for (size_t l = 0; l < layers.size(); l++) fillLayer(l);
+    }
+    if (base_h0) combineLayers();
+    else         spectrumChanged();
+}
+
+void OceanSimulation::clearLayers() {
+    if (!base_h0) return;
+    for (size_t l = 0; l < layer_h0.size(); l++) delete [] layer_h0[l];
+    layers.clear();
+    layer_h0.clear();
+
+    combineLayers();
+    delete [] base_h0;
+    base_h0 = 0;
+}
+
+// h0 tables the frames read = base layer + every extra layer. Summed on the members,
+// complex's operators count into shared statics the workers would race on.
+void OceanSimulation::combineLayers() {
+    const int size = Nplus1 * Nplus1;
+    Parallel::forEach(0, Nplus1, [this, size](int begin, int end) {
+        for (int index = begin * Nplus1; index < end * Nplus1; index++) {
+            complex h0 = base_h0[index], h0mk = base_h0[size + index];
+            for (size_t l = 0; l < layer_h0.size(); l++) {
+                h0.a   += layer_h0[l][index].a;
+                h0.b   += layer_h0[l][index].b;
+                h0mk.a += layer_h0[l][size + index].a;
+                h0mk.b += layer_h0[l][size + index].b;
+            }
+            h0_tk[index]       = h0;
+            h0_tmk_conj[index] = h0mk;
+        }
+    });
+    spectrumChanged();
+}
+
+// refreshes everything derived from the h0 tables
+void OceanSimulation::spectrumChanged() {
+    if (prune_mask) setPruneThreshold(prune_threshold);
+    if (wave_model == OCEAN_WAVES_GERSTNER) setWaveModel(OCEAN_WAVES_GERSTNER, gerstner_count);
+    frames_valid = false;
+}
+
+complex OceanSimulation::hTilde(float t, int n_prime, int m_prime) {
+    int index = m_prime * Nplus1 + n_prime;
+
+    complex htilde0(h0_tk[index]);
+    complex htilde0mkconj(h0_tmk_conj[index]);
+
+    float omegat = omega[index] * t;
+
+    float cos_ = cos(omegat);
+    float sin_ = sin(omegat);
+
+    complex c0(cos_,  sin_);
+    complex c1(cos_, -sin_);
+
+    complex res = htilde0 * c0 + htilde0mkconj * c1;
+
+    return htilde0 * c0 + htilde0mkconj*c1;
+}
+
+complex_vector_normal OceanSimulation::h_D_and_n(vector2 x, float t) {
+    complex h(0.0f, 0.0f);
+    vector2 D(0.0f, 0.0f);
+    vector3 n(0.0f, 0.0f, 0.0f);
+
+    complex c, res, htilde_c;
+    vector2 k;
+    float kx, kz, k_length, k_dot_x;
+
+    for (int m_prime = 0; m_prime < N; m_prime++) {
+        kz = 2.0f * M_PI * (m_prime - N / 2.0f) / length;
+        for (int n_prime = 0; n_prime < N; n_prime++) {
+            kx = 2.0f * M_PI * (n_prime - N / 2.0f) / length;
+            k = vector2(kx, kz);
+
+            k_length = k.length();
+            k_dot_x = k * x;
+
+            c = complex(cos(k_dot_x), sin(k_dot_x));
+            htilde_c = hTilde(t, n_prime, m_prime) * c;
+
+            h = h + htilde_c;
+
+            n = n + vector3(-kx * htilde_c.b, 0.0f, -kz * htilde_c.b);
+
+            if (k_length < 0.000001) continue;
+            D = D + vector2(kx / k_length * htilde_c.b, kz / k_length * htilde_c.b);
+        }
+    }
+    
+    n = (vector3(0.0f, 1.0f, 0.0f) - n).unit();
+
+    complex_vector_normal cvn;
+    cvn.h = h;
+    cvn.D = D;
+    cvn.n = n;
+    return cvn;
+}
+
+// one row of the reference sum: for a vertex at column phases e(i kx x) = er + i ei,
+// P[0] += H e, P[1] += kx H e, P[2] += kx/|k| H e, P[3] += kz/|k| H e over the N bins
+static void referenceRow(int N, const float *hr, const float *hi, const float *er, const float *ei,
+                         const float *kx, const float *kxk, const float *kzk, float P[4][2]) {
+    int n = 0;
+    for (int c = 0; c < 4; c++) P[c][0] = P[c][1] = 0.0f;
+#if defined(__SSE__)
+    __m128 s[4][2];
+    for (int c = 0; c < 4; c++) s[c][0] = s[c][1] = _mm_setzero_ps();
+    for (; n + 4 <= N; n += 4) {
+        __m128 a = _mm_loadu_ps(hr + n), b = _mm_loadu_ps(hi + n);
+        __m128 c = _mm_loadu_ps(er + n), d = _mm_loadu_ps(ei + n);
+        __m128 qr = _mm_sub_ps(_mm_mul_ps(a, c), _mm_mul_ps(b, d));
+        __m128 qi = _mm_add_ps(_mm_mul_ps(a, d), _mm_mul_ps(b, c));
+        __m128 w1 = _mm_loadu_ps(kx + n), w2 = _mm_loadu_ps(kxk + n), w3 = _mm_loadu_ps(kzk + n);
+        s[0][0] = _mm_add_ps(s[0][0], qr);
+        s[0][1] = _mm_add_ps(s[0][1], qi);
+        s[1][0] = _mm_add_ps(s[1][0], _mm_mul_ps(w1, qr));
+        s[1][1] = _mm_add_ps(s[1][1], _mm_mul_ps(w1, qi));
+        s[2][0] = _mm_add_ps(s[2][0], _mm_mul_ps(w2, qr));
+        s[2][1] = _mm_add_ps(s[2][1], _mm_mul_ps(w2, qi));
+        s[3][0] = _mm_add_ps(s[3][0], _mm_mul_ps(w3, qr));
+        s[3][1] = _mm_add_ps(s[3][1], _mm_mul_ps(w3, qi));
+    }
+    float lanes[4];
+    for (int c = 0; c < 4; c++) {
+        for (int part = 0; part < 2; part++) {
+            _mm_storeu_ps(lanes, s[c][part]);
+            P[c][part] = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+        }
+    }
+#endif
+    for (; n < N; n++) {
+        float qr = hr[n] * er[n] - hi[n] * ei[n];
+        float qi = hr[n] * ei[n] + hi[n] * er[n];
+        P[0][0] += qr;          P[0][1] += qi;
+        P[1][0] += kx[n] * qr;  P[1][1] += kx[n] * qi;
+        P[2][0] += kxk[n] * qr; P[2][1] += kxk[n] * qi;
+        P[3][0] += kzk[n] * qr; P[3][1] += kzk[n] * qi;
+    }
+}
+
+// Direct O(N^4) sum of every bin at every texel -- the same result as h_D_and_n() for
+// each rest position, used as the reference the FFT paths are checked against. h~(k, t)
+// is taken once per bin and exp(i k.x) splits into a column and a row phase taken
+// from one table, so the inner loop over a row of bins is multiplies and adds only,
+// four bins per SSE step. Each row of bins is summed in float, the rows in double.
+// Rows of texels are spread over the worker threads.
+void OceanSimulation::evaluateWaves(float t) {
+    const float lambda = -1.0f;
+    const int size = N * N;
+    std::vector<float> hr(size), hi(size), kxk(size), kzk(size), k(N), er(size), ei(size);
+
+    for (int n_prime = 0; n_prime < N; n_prime++) k[n_prime] = 2.0f * M_PI * (n_prime - N / 2.0f) / length;
+    Parallel::forEach(0, N, [&](int begin, int end) {
+        for (int m_prime = begin; m_prime < end; m_prime++) {
+            for (int n_prime = 0; n_prime < N; n_prime++) {
+                // hTilde() written out on plain floats
+                int index = m_prime * N + n_prime, bin = m_prime * Nplus1 + n_prime;
+                const complex &h0 = h0_tk[bin], &h0mk = h0_tmk_conj[bin];
+                float omegat = omega[bin] * t;
+                float c = cos(omegat), s = sin(omegat);
+                float k_length = sqrtf(k[n_prime] * k[n_prime] + k[m_prime] * k[m_prime]);
+                hr[index]  = (h0.a * c - h0.b * s) + (h0mk.a * c + h0mk.b * s);
+                hi[index]  = (h0.a * s + h0.b * c) + (h0mk.b * c - h0mk.a * s);
+                kxk[index] = k_length < 0.000001f ? 0.0f : k[n_prime] / k_length;
+                kzk[index] = k_length < 0.000001f ? 0.0f : k[m_prime] / k_length;
+
+                // row m' of the phase table: exp(i k_n' x) at position x of texel m'
+                double x = (m_prime - N / 2.0) * length / N;
+                double phase = 2.0 * M_PI * (n_prime - N / 2.0) / length * x;
+                er[index] = (float)cos(phase);
+                ei[index] = (float)sin(phase);
+            }
+        }
+    });
+
+    Parallel::forEach(0, N, [&](int begin, int end) {
+        float P[4][2];
+        for (int m_prime = begin; m_prime < end; m_prime++) {
+            const float *row_r = &er[m_prime * N], *row_i = &ei[m_prime * N];
+            for (int n_prime = 0; n_prime < N; n_prime++) {
+                const float *col_r = &er[n_prime * N], *col_i = &ei[n_prime * N];
+                double h = 0.0, sx = 0.0, sz = 0.0, dx = 0.0, dz = 0.0;
+                for (int m = 0; m < N; m++) {
+                    referenceRow(N, &hr[m * N], &hi[m * N], col_r, col_i, &k[0], &kxk[m * N], &kzk[m * N], P);
+                    double cr = row_r[m], ci = row_i[m];
+                    h  += cr * P[0][0] - ci * P[0][1];
+                    double im0 = cr * P[0][1] + ci * P[0][0];
+                    sx += cr * P[1][1] + ci * P[1][0];
+                    sz += k[m] * im0;
+                    dx += cr * P[2][1] + ci * P[2][0];
+                    dz += cr * P[3][1] + ci * P[3][0];
+                }
+                int index = m_prime * N + n_prime;
+                double r = 1.0 / sqrt(sx * sx + 1.0 + sz * sz);
+                out_height[index] = (float)h;
+                out_dx[index]     = lambda * (float)dx;
+                out_dz[index]     = lambda * (float)dz;
+                out_nx[index]     = (float)(sx * r);
+                out_ny[index]     = (float)r;
+                out_nz[index]     = (float)(sz * r);
+            }
+        }
+    });
+    markPyramid(out_height, out_dx, out_dz);
+}
+
+// Checks the FFT path (with the current pruning, detail and normal mode) against the
+// reference sum. The FFT grid starts half a patch further along than the rest
+// positions of the reference, so FFT texel (n' + N/2, m' + N/2) is compared with
+// reference texel (n', m'). Leaves the FFT frame in the output grids.
+void OceanSimulation::compareReference(float t, ocean_reference_error &error) {
+    const int size = N * N, mask = N - 1;
+    std::vector<float> reference(6 * size);
+
+    evaluateWaves(t);
+    const float *grids[6] = { out_height, out_dx, out_dz, out_nx, out_ny, out_nz };
+    for (int c = 0; c < 6; c++) std::copy(grids[c], grids[c] + size, &reference[c * size]);
+
+    evaluateWavesFFT(t);
+
+    double peak[3] = { 0.0, 0.0, 0.0 }, sum[3] = { 0.0, 0.0, 0.0 };
+    for (int m_prime = 0; m_prime < N; m_prime++) {
+        for (int n_prime = 0; n_prime < N; n_prime++) {
+            int r = m_prime * N + n_prime;
+            int f = ((m_prime + N / 2) & mask) * N + ((n_prime + N / 2) & mask);
+            double e[3];
+            e[0] = fabs(out_height[f] - reference[r]);
+            e[1] = sqrt((out_dx[f] - reference[size + r]) * (out_dx[f] - reference[size + r]) +
+                        (out_dz[f] - reference[2 * size + r]) * (out_dz[f] - reference[2 * size + r]));
+            // atan2 of |a x b| and a.b stays accurate for the tiny angles acos would round away
+            double ax = out_nx[f], ay = out_ny[f], az = out_nz[f];
+            double bx = reference[3 * size + r], by = reference[4 * size + r], bz = reference[5 * size + r];
+            double cx = ay * bz - az * by, cy = az * bx - ax * bz, cz = ax * by - ay * bx;
+            e[2] = atan2(sqrt(cx * cx + cy * cy + cz * cz), ax * bx + ay * by + az * bz) * 180.0 / M_PI;
+            for (int c = 0; c < 3; c++) {
+                sum[c] += e[c] * e[c];
+                if (e[c] > peak[c]) peak[c] = e[c];
+            }
+        }
+    }
+    error.height_max         = (float)peak[0];
+    error.height_rms         = (float)sqrt(sum[0] / size);
+    error.displacement_max   = (float)peak[1];
+    error.displacement_rms   = (float)sqrt(sum[1] / size);
+    error.normal_max_degrees = (float)peak[2];
+    error.normal_rms_degrees = (float)sqrt(sum[2] / size);
+}
+
+// Drops every bin whose initial energy |h0(k)|^2 + |h0(-k)|^2 is below relative_energy
+// times the strongest bin; 0 transforms everything. Since |h~(k, t)| never exceeds
+// |h0(k)| + |h0(-k)|, the sum of that over the dropped bins bounds the error of any
+// height or displacement texel, and the same sum weighted by |k| bounds the slopes.
+void OceanSimulation::setPruneThreshold(float relative_energy) {
+    if (prune_mask) delete [] prune_mask;
+    if (prune_rows) delete [] prune_rows;
+    prune_mask = 0;
+    prune_rows = 0;
+    prune_stats.bins_kept    = 1.0f;
+    prune_stats.work_saved   = 0.0f;
+    prune_stats.height_error = 0.0f;
+    prune_stats.slope_error  = 0.0f;
+    prune_threshold = relative_energy;
+    frames_valid = false;
+    if (relative_energy <= 0.0f) return;
+
+    const int mask = N - 1, half = N / 2;
+    float peak = 0.0f;
+    for (int m_prime = 0; m_prime < N; m_prime++) {
+        for (int n_prime = 0; n_prime < N; n_prime++) {
+            int index = m_prime * Nplus1 + n_prime;
+            complex a = h0_tk[index], b = h0_tmk_conj[index];
+            float energy = a.a * a.a + a.b * a.b + b.a * b.a + b.b * b.b;
+            if (energy > peak) peak = energy;
+        }
+    }
+
+    prune_mask = new unsigned char[N*N];
+    prune_rows = new unsigned char[N]();
+    int kept = 0;
+    double height_error = 0.0, slope_error = 0.0;
+    for (int m_prime = 0; m_prime < N; m_prime++) {
+        float kz = M_PI * (2.0f * m_prime - N) / length;
+        for (int n_prime = 0; n_prime < N; n_prime++) {
+            float kx = M_PI * (2.0f * n_prime - N) / length;
+            int index = m_prime * Nplus1 + n_prime;
+            int fft_index = ((m_prime + half) & mask) * N + ((n_prime + half) & mask);
+            complex a = h0_tk[index], b = h0_tmk_conj[index];
+            float energy = a.a * a.a + a.b * a.b + b.a * b.a + b.b * b.b;
+
+            prune_mask[fft_index] = energy >= relative_energy * peak;
+            if (prune_mask[fft_index]) {
+                prune_rows[fft_index / N] = 1;
+                kept++;
+            } else {
+                float amplitude = sqrtf(a.a * a.a + a.b * a.b) + sqrtf(b.a * b.a + b.b * b.b);
+                height_error += amplitude;
+                slope_error  += amplitude * sqrtf(kx * kx + kz * kz);
+            }
+        }
+    }
+    prune_stats.bins_kept    = (float)kept / (N*N);
+    prune_stats.height_error = (float)height_error;
+    prune_stats.slope_error  = (float)slope_error;
+}
+
+// normalizes (-sx, 1, -sz) for count texels, taking the real parts of the slope FFTs
+static void slopeNormals(const complex *slopex, const complex *slopez,
+                         float *nx, float *ny, float *nz, int count) {
+    int i = 0;
+#if defined(__SSE__)
+    const __m128 one = _mm_set1_ps(1.0f), half = _mm_set1_ps(0.5f), three = _mm_set1_ps(3.0f);
+    for (; i + 4 <= count; i += 4) {
+        // 4 complex = 8 floats, keep the even (real) lanes
+        __m128 sx = _mm_shuffle_ps(_mm_loadu_ps(&slopex[i].a), _mm_loadu_ps(&slopex[i + 2].a), _MM_SHUFFLE(2, 0, 2, 0));
+        __m128 sz = _mm_shuffle_ps(_mm_loadu_ps(&slopez[i].a), _mm_loadu_ps(&slopez[i + 2].a), _MM_SHUFFLE(2, 0, 2, 0));
+        __m128 d = _mm_add_ps(one, _mm_add_ps(_mm_mul_ps(sx, sx), _mm_mul_ps(sz, sz)));
+        // rsqrt estimate plus one Newton step: r * (3 - d * r * r) / 2
+        __m128 r = _mm_rsqrt_ps(d);
+        r = _mm_mul_ps(_mm_mul_ps(half, r), _mm_sub_ps(three, _mm_mul_ps(d, _mm_mul_ps(r, r))));
+        _mm_storeu_ps(nx + i, _mm_sub_ps(_mm_setzero_ps(), _mm_mul_ps(sx, r)));
+        _mm_storeu_ps(ny + i, r);
+        _mm_storeu_ps(nz + i, _mm_sub_ps(_mm_setzero_ps(), _mm_mul_ps(sz, r)));
+    }
+#endif
+    for (; i < count; i++) {
+        float sx = slopex[i].a, sz = slopez[i].a;
+        float r = 1.0f / sqrtf(1.0f + sx * sx + sz * sz);
+        nx[i] = -sx * r;
+        ny[i] = r;
+        nz[i] = -sz * r;
+    }
+}
+
+// Transforms of size N >> level for the first slices slices of the FFT passes. cFFT
+// works in its own buffers, so every slice that runs concurrently needs its own.
+cFFT *const *OceanSimulation::transforms(int level, int slices) {
+    std::vector<cFFT*> &list = ffts[level];
+    while ((int)list.size() < slices) list.push_back(new cFFT(N >> level));
+    return &list[0];
+}
+
+// Fills the central size*size bins of the spectrum at time t into tilde[] (h, slopex,
+// slopez, dx, dz) and runs the inverse FFT on them, size = N >> level. Every pass is
+// split over the worker threads: the spectrum and the row pass by rows, the column
+// pass by columns, one transform per slice.
+void OceanSimulation::transformSpectrum(float t, int level, complex *const *tilde,
+                                        bool slopes, const unsigned char *prune, const unsigned char *rows) {
+    complex *h = tilde[0], *sx = tilde[1], *sz = tilde[2], *dx = tilde[3], *dz = tilde[4];
+
+    // The spectrum is stored centred (k = 0 at size/2), which leaves a (-1)^(n+m) factor
+    // on every output texel. Writing each bin half a period over does the same
+    // modulation for free, so the output stage needs no sign.
+    const int size = N >> level;
+    const int mask = size - 1, half = size / 2, offset = (N - size) / 2;
+
+    {
+        PerfScope stage("spectrum");
+        TRACE_ZONE("spectrum");
+        Parallel::forEach(0, size, [&](int begin, int end) {
+            for (int m_prime = begin; m_prime < end; m_prime++) {
+                float kz = M_PI * (2.0f * m_prime - size) / length;
+                for (int n_prime = 0; n_prime < size; n_prime++) {
+                    float kx = M_PI*(2 * n_prime - size) / length;
+                    float len = sqrt(kx * kx + kz * kz);
+                    int index = ((m_prime + half) & mask) * size + ((n_prime + half) & mask);
+                    if (prune && !prune[index]) continue;     // never read by the pruned FFT
+
+                    h[index] = hTilde(t, n_prime + offset, m_prime + offset);
+                    if (slopes) {
+                        sx[index] = h[index] * complex(0, kx);
+                        sz[index] = h[index] * complex(0, kz);
+                    }
+                    if (len < 0.000001f) {
+                        dx[index]     = complex(0.0f, 0.0f);
+                        dz[index]     = complex(0.0f, 0.0f);
+                    } else {
+                        dx[index]     = h[index] * complex(0, -kx/len);
+                        dz[index]     = h[index] * complex(0, -kz/len);
+                    }
+                }
+            }
+        });
+    }
+
+    const int slices = Parallel::threads() < size ? Parallel::threads() : size;
+    cFFT *const *transform = transforms(level, slices);
+
+    // with pruning, empty rows are skipped outright (the column pass never reads them)
+    // and each column has the zero pattern of the rows
+    {
+        PerfScope stage("rows");
+        TRACE_ZONE("rows");
+        Parallel::forEach(0, slices, [&](int begin, int end) {
+            for (int slice = begin; slice < end; slice++) {
+                for (int m_prime = slice * size / slices; m_prime < (slice + 1) * size / slices; m_prime++) {
+                    if (rows && !rows[m_prime]) continue;
+                    const unsigned char *nonzero = prune ? prune + m_prime * size : 0;
+                    for (int c = 0; c < 5; c++) {
+                        if (!slopes && (c == 1 || c == 2)) continue;
+                        transform[slice]->fft(tilde[c], tilde[c], 1, m_prime * size, nonzero);
+                    }
+                }
+            }
+        });
+    }
+    PerfScope stage("columns");
+    TRACE_ZONE("columns");
+    Parallel::forEach(0, slices, [&](int begin, int end) {
+        for (int slice = begin; slice < end; slice++) {
+            for (int n_prime = slice * size / slices; n_prime < (slice + 1) * size / slices; n_prime++) {
+                for (int c = 0; c < 5; c++) {
+                    if (!slopes && (c == 1 || c == 2)) continue;
+                    transform[slice]->fft(tilde[c], tilde[c], size, n_prime, rows);
+                }
+            }
+        }
+    });
+}
+
+// Bilinearly resamples the real part of a size*size LOD grid onto the N*N grid and
+// mixes it in with weight. Texel n' of the full grid sits at n' * size / N.
+static void upsampleGrid(const complex *src, int size, complex *dst, int N, float weight) {
+    const int ratio = N / size, mask = size - 1;
+    for (int m_prime = 0; m_prime < N; m_prime++) {
+        int m0 = m_prime / ratio, m1 = (m0 + 1) & mask;
+        float sv = (float)(m_prime % ratio) / ratio;
+        for (int n_prime = 0; n_prime < N; n_prime++) {
+            int n0 = n_prime / ratio, n1 = (n0 + 1) & mask;
+            float su = (float)(n_prime % ratio) / ratio;
+            float h0 = src[m0 * size + n0].a + (src[m0 * size + n1].a - src[m0 * size + n0].a) * su;
+            float h1 = src[m1 * size + n0].a + (src[m1 * size + n1].a - src[m1 * size + n0].a) * su;
+            float value = h0 + (h1 - h0) * sv;
+            float &out = dst[m_prime * N + n_prime].a;
+            out = weight >= 1.0f ? value : out + (value - out) * weight;
+        }
+    }
+}
+
+// runs the transform of one LOD level and leaves its real parts in the full size
+// h_tilde buffers, mixed in with weight
+void OceanSimulation::evaluateLevel(float t, int level, float weight, bool slopes) {
+    complex *full[5] = { h_tilde, h_tilde_slopex, h_tilde_slopez, h_tilde_dx, h_tilde_dz };
+    if (level == 0) {
+        transformSpectrum(t, 0, full, slopes, prune_mask, prune_rows);
+        return;
+    }
+
+    int size = N >> level;
+    if (!lod_tilde[level - 1][0]) {
+        for (int c = 0; c < 5; c++) lod_tilde[level - 1][c] = new complex[size * size];
+    }
+    transformSpectrum(t, level, lod_tilde[level - 1], slopes, 0, 0);
+    PerfScope stage("upsample");
+    TRACE_ZONE("upsample");
+    for (int c = 0; c < 5; c++) {
+        if (!slopes && (c == 1 || c == 2)) continue;
+        upsampleGrid(lod_tilde[level - 1][c], size, full[c], N, weight);
+    }
+}
+
+// 0 runs the full N FFT, 1 and 2 run N/2 and N/4 on the central (low frequency) part
+// of the spectrum. A fractional level crossfades the two neighbouring levels, so a
+// level that changes smoothly never pops.
+void OceanSimulation::setDetail(float level) {
+    float coarsest = 0.0f;
+    while (coarsest < 2.0f && (N >> ((int)coarsest + 1)) >= 4) coarsest += 1.0f;
+    detail = level < 0.0f ? 0.0f : level > coarsest ? coarsest : level;
+    frames_valid = false;
+}
+
+// the frames cached by setSimulationRate() hold normals of the mode they were made with
+void OceanSimulation::setNormalMode(ocean_normal_mode mode) {
+    normal_mode = mode;
+    frames_valid = false;
+}
+
+// one FFT frame into the output grids, without the height pyramid
+void OceanSimulation::simulateFFT(float t) {
+    TRACE_ZONE("simulateFFT");
+    float lambda = -1.0f;
+    int index;
+    bool slopes = normal_mode == OCEAN_NORMALS_FFT;
+    int level = (int)detail;
+    float blend = detail - level;
+
+    for (int l = 0; l < 3; l++) {
+        for (size_t i = 0; i < ffts[l].size(); i++) ffts[l][i]->multiplies = 0;
+    }
+
+    evaluateLevel(t, level, 1.0f, slopes);
+    if (blend > 0.0f) evaluateLevel(t, level + 1, blend, slopes);
+
+    int log_2_N = 0;
+    while ((1 << log_2_N) < N) log_2_N++;
+    float full = (slopes ? 5.0f : 3.0f) * 2 * N * (N / 2) * log_2_N;
+    float done = 0.0f;
+    for (int l = 0; l < 3; l++) {
+        for (size_t i = 0; i < ffts[l].size(); i++) done += ffts[l][i]->multiplies;
+    }
+    prune_stats.work_saved = 1.0f - done / full;
+
+    PerfScope stage("output");
+    TRACE_ZONE("output");
+    for (index = 0; index < N*N; index++) {
+        out_height[index] = h_tilde[index].a;
+        out_dx[index] = h_tilde_dx[index].a * lambda;
+        out_dz[index] = h_tilde_dz[index].a * lambda;
+    }
+    if (slopes) slopeNormals(h_tilde_slopex, h_tilde_slopez, out_nx, out_ny, out_nz, N*N);
+    if (!slopes) differenceNormals();
+}
+
+void OceanSimulation::evaluateWavesFFT(float t) {
+    TRACE_ZONE("evaluateWavesFFT");
+    simulateFFT(t);
+    markPyramid(out_height, out_dx, out_dz);
+}
+
+// The FFT output is h(x, t) = Re sum_k (h0(k) exp(i w t) + h0mk*(k) exp(-i w t)) exp(i k.x),
+// so every bin holds two travelling waves: amplitude |h0(k)| moving one way in time and
+// |h0mk*(k)| the other. The Gerstner model keeps the strongest of those 2 N^2 waves
+// and sums them directly: same spectrum, wind and repeat period, far fewer terms.
+// waves <= 0 goes back to the FFT.
+void OceanSimulation::setWaveModel(ocean_wave_model model, int waves) {
+    if (gerstner_waves) delete [] gerstner_waves;
+    if (gerstner_basis) delete [] gerstner_basis;
+    gerstner_waves = 0;
+    gerstner_basis = 0;
+    gerstner_count = 0;
+    wave_model = model;
+    frames_valid = false;
+    if (model != OCEAN_WAVES_GERSTNER) return;
+    if (waves > 2*N*N) waves = 2*N*N;
+    if (waves <= 0) {
+        wave_model = OCEAN_WAVES_FFT;
+        return;
+    }
+
+    // candidate 2 * bin is the h0 wave of bin, 2 * bin + 1 the h0mk* one
+    std::vector<int> candidates(2*N*N);
+    std::vector<float> energy(2*N*N);
+    for (int m_prime = 0; m_prime < N; m_prime++) {
+        for (int n_prime = 0; n_prime < N; n_prime++) {
+            int bin = m_prime * N + n_prime;
+            complex h = h0_tk[m_prime * Nplus1 + n_prime], hmk = h0_tmk_conj[m_prime * Nplus1 + n_prime];
+            candidates[2 * bin]     = 2 * bin;
+            candidates[2 * bin + 1] = 2 * bin + 1;
+            energy[2 * bin]         = h.a * h.a + h.b * h.b;
+            energy[2 * bin + 1]     = hmk.a * hmk.a + hmk.b * hmk.b;
+        }
+    }
+    std::partial_sort(candidates.begin(), candidates.begin() + waves, candidates.end(),
+                      [&energy](int a, int b) { return energy[a] > energy[b]; });
+
+    gerstner_count = waves;
+    gerstner_waves = new gerstner_wave[waves];
+    gerstner_basis = new float[2 * waves * N];
+    for (int i = 0; i < waves; i++) {
+        int bin     = candidates[i] / 2;
+        bool back   = candidates[i] & 1;
+        int n_prime = bin % N, m_prime = bin / N;
+        int index   = m_prime * Nplus1 + n_prime;
+        complex h   = back ? h0_tmk_conj[index] : h0_tk[index];
+        float kx    = M_PI * (2 * n_prime - N) / length;
+        float kz    = M_PI * (2 * m_prime - N) / length;
+        float k     = sqrtf(kx * kx + kz * kz);
+        float a     = sqrtf(h.a * h.a + h.b * h.b);
+
+        gerstner_wave &wave = gerstner_waves[i];
+        wave.kz    = kz;
+        wave.omega = back ? -omega[index] : omega[index];
+        wave.phase = atan2f(h.b, h.a);
+        wave.a     = a;
+        wave.a_dx  = k > 0.000001f ? -a * kx / k : 0.0f;     // lambda = -1 as in the FFT path
+        wave.a_dz  = k > 0.000001f ? -a * kz / k : 0.0f;
+        wave.a_kx  = a * kx;
+        wave.a_kz  = a * kz;
+
+        // exp(i kx x) along a row does not depend on time or row, so it is tabulated.
+        // Like the FFT, texel n' is evaluated at n' * length / N.
+        for (int n = 0; n < N; n++) {
+            float x = n * length / N;
+            gerstner_basis[(2 * i)     * N + n] = cosf(kx * x);
+            gerstner_basis[(2 * i + 1) * N + n] = sinf(kx * x);
+        }
+    }
+}
+
+// adds one wave to a row: exp(i theta) = basis(n) * c with c = exp(i (kz z + w t + phase))
+static void gerstnerRow(int N, const float *bc, const float *bs, float cr, float ci,
+                        const gerstner_wave &wave, bool slopes,
+                        float *h, float *dx, float *dz, float *sx, float *sz) {
+    int n = 0;
+#if defined(__SSE__)
+    const __m128 vcr = _mm_set1_ps(cr), vci = _mm_set1_ps(ci);
+    const __m128 a = _mm_set1_ps(wave.a), a_dx = _mm_set1_ps(wave.a_dx), a_dz = _mm_set1_ps(wave.a_dz);
+    const __m128 a_kx = _mm_set1_ps(wave.a_kx), a_kz = _mm_set1_ps(wave.a_kz);
+    for (; n + 4 <= N; n += 4) {
+        __m128 c = _mm_loadu_ps(bc + n), s = _mm_loadu_ps(bs + n);
+        __m128 re = _mm_sub_ps(_mm_mul_ps(c, vcr), _mm_mul_ps(s, vci));
+        __m128 im = _mm_add_ps(_mm_mul_ps(c, vci), _mm_mul_ps(s, vcr));
+        _mm_storeu_ps(h + n,  _mm_add_ps(_mm_loadu_ps(h + n),  _mm_mul_ps(a, re)));
+        _mm_storeu_ps(dx + n, _mm_add_ps(_mm_loadu_ps(dx + n), _mm_mul_ps(a_dx, im)));
+        _mm_storeu_ps(dz + n, _mm_add_ps(_mm_loadu_ps(dz + n), _mm_mul_ps(a_dz, im)));
+        if (slopes) {
+            _mm_storeu_ps(sx + n, _mm_add_ps(_mm_loadu_ps(sx + n), _mm_mul_ps(a_kx, im)));
+            _mm_storeu_ps(sz + n, _mm_add_ps(_mm_loadu_ps(sz + n), _mm_mul_ps(a_kz, im)));
+        }
+    }
+#endif
+    for (; n < N; n++) {
+        float re = bc[n] * cr - bs[n] * ci;
+        float im = bc[n] * ci + bs[n] * cr;
+        h[n]  += wave.a    * re;
+        dx[n] += wave.a_dx * im;
+        dz[n] += wave.a_dz * im;
+        if (slopes) {
+            sx[n] += wave.a_kx * im;
+            sz[n] += wave.a_kz * im;
+        }
+    }
+}
+
+// one Gerstner frame into the output grids, without the height pyramid
+void OceanSimulation::simulateGerstner(float t) {
+    PerfScope stage("gerstner");
+    TRACE_ZONE("gerstner");
+    bool slopes = normal_mode == OCEAN_NORMALS_FFT;
+
+    std::fill(out_height, out_height + N*N, 0.0f);
+    std::fill(out_dx, out_dx + N*N, 0.0f);
+    std::fill(out_dz, out_dz + N*N, 0.0f);
+    if (slopes) {
+        std::fill(out_nx, out_nx + N*N, 0.0f);
+        std::fill(out_nz, out_nz + N*N, 0.0f);
+    }
+
+    for (int m_prime = 0; m_prime < N; m_prime++) {
+        float z = m_prime * length / N;
+        int row = m_prime * N;
+        for (int i = 0; i < gerstner_count; i++) {
+            const gerstner_wave &wave = gerstner_waves[i];
+            float theta = wave.kz * z + wave.omega * t + wave.phase;
+            gerstnerRow(N, gerstner_basis + (2 * i) * N, gerstner_basis + (2 * i + 1) * N, cosf(theta), sinf(theta),
+                        wave, slopes, out_height + row, out_dx + row, out_dz + row, out_nx + row, out_nz + row);
+        }
+    }
+
+    if (!slopes) {
+        differenceNormals();
+        return;
+    }
+    // out_nx and out_nz hold -slope, the normal is (-sx, 1, -sz)
+    for (int index = 0; index < N*N; index++) {
+        float r = 1.0f / sqrtf(1.0f + out_nx[index] * out_nx[index] + out_nz[index] * out_nz[index]);
+        out_nx[index] *= r;
+        out_ny[index]  = r;
+        out_nz[index] *= r;
+    }
+}
+
+void OceanSimulation::evaluateWavesGerstner(float t) {
+    simulateGerstner(t);
+    markPyramid(out_height, out_dx, out_dz);
+}
+
+// one frame of the selected wave model, without the height pyramid
+void OceanSimulation::simulate(float t) {
+    if (wave_model == OCEAN_WAVES_GERSTNER) simulateGerstner(t);
+    else                                    simulateFFT(t);
+}
+
+// hz simulation steps per unit of t; 0 runs the FFT on every evaluate(). Otherwise
+// evaluate() keeps the FFT frames of the two steps around t and blends them, so the
+// FFT cost follows the simulation rate rather than the rate evaluate() is called at.
+void OceanSimulation::setSimulationRate(float hz) {
+    step = hz > 0.0f ? 1.0f / hz : 0.0f;
+    frames_valid = false;
+    if (step > 0.0f && !frames[0][0]) {
+        for (int f = 0; f < 2; f++) {
+            for (int c = 0; c < 6; c++) frames[f][c] = new float[N*N];
+        }
+    }
+}
+
+// simulates step k into frames[slot]
+void OceanSimulation::simulateStep(int k, int slot) {
+    simulate(k * step);
+    const float *grids[6] = { out_height, out_dx, out_dz, out_nx, out_ny, out_nz };
+    for (int c = 0; c < 6; c++) std::copy(grids[c], grids[c] + N*N, frames[slot][c]);
+}
+
+void OceanSimulation::evaluateDecimated(float t) {
+    TRACE_ZONE("evaluateDecimated");
+    double position = t / step;
+    int k = (int)floor(position);
+    float blend = (float)(position - k);
+
+    if (!frames_valid || k != frame_index) {
+        if (frames_valid && k == frame_index + 1) {
+            for (int c = 0; c < 6; c++) std::swap(frames[0][c], frames[1][c]);
+        } else {
+            simulateStep(k, 0);
+        }
+        simulateStep(k + 1, 1);
+        frame_index  = k;
+        frames_valid = true;
+        markPyramid(frames[0][0], frames[0][1], frames[0][2],
+                    frames[1][0], frames[1][1], frames[1][2]);
+    }
+
+    float *grids[6] = { out_height, out_dx, out_dz, out_nx, out_ny, out_nz };
+    for (int c = 0; c < 6; c++) {
+        const float *a = frames[0][c], *b = frames[1][c];
+        float *out = grids[c];
+        for (int index = 0; index < N*N; index++) out[index] = a[index] + (b[index] - a[index]) * blend;
+    }
+    for (int index = 0; index < N*N; index++) {
+        float r = 1.0f / sqrtf(out_nx[index] * out_nx[index] + out_ny[index] * out_ny[index] + out_nz[index] * out_nz[index]);
+        out_nx[index] *= r;
+        out_ny[index] *= r;
+        out_nz[index] *= r;
+    }
+}
+
+// normal of the displaced surface at one texel from its four neighbours: the cross
+// product of the tangents (P(n+1) - P(n-1)) and (P(m+1) - P(m-1)), where the rest
+// positions contribute 2 * spacing to the x and z differences
+static inline void differenceNormal(float spacing2,
+                                    float h_l, float h_r, float dx_l, float dx_r, float dz_l, float dz_r,
+                                    float h_d, float h_u, float dx_d, float dx_u, float dz_d, float dz_u,
+                                    float &nx, float &ny, float &nz) {
+    float ux = spacing2 + dx_r - dx_l, uy = h_r - h_l, uz = dz_r - dz_l;
+    float vx = dx_u - dx_d,            vy = h_u - h_d, vz = spacing2 + dz_u - dz_d;
+    float x = vy * uz - vz * uy;
+    float y = vz * ux - vx * uz;
+    float z = vx * uy - vy * ux;
+    float r = 1.0f / sqrtf(x * x + y * y + z * z);
+    nx = x * r;
+    ny = y * r;
+    nz = z * r;
+}
+
+// replaces the two slope FFTs: normals straight from the displaced output grid. The
+// interior of every row is a plain loop over contiguous texels so it vectorizes,
+// the first and last column wrap around.
+void OceanSimulation::differenceNormals() {
+    const float spacing2 = 2.0f * length / N;
+    const int mask = N - 1;
+
+    for (int m_prime = 0; m_prime < N; m_prime++) {
+        int row  = m_prime * N;
+        int down = ((m_prime - 1) & mask) * N;
+        int up   = ((m_prime + 1) & mask) * N;
+        const float *h  = out_height + row, *hd  = out_height + down, *hu  = out_height + up;
+        const float *dx = out_dx + row,     *dxd = out_dx + down,     *dxu = out_dx + up;
+        const float *dz = out_dz + row,     *dzd = out_dz + down,     *dzu = out_dz + up;
+        float *nx = out_nx + row, *ny = out_ny + row, *nz = out_nz + row;
+
+        for (int n_prime = 1; n_prime < N - 1; n_prime++) {
+            differenceNormal(spacing2,
+                             h[n_prime - 1],  h[n_prime + 1],  dx[n_prime - 1], dx[n_prime + 1], dz[n_prime - 1], dz[n_prime + 1],
+                             hd[n_prime],     hu[n_prime],     dxd[n_prime],    dxu[n_prime],    dzd[n_prime],    dzu[n_prime],
+                             nx[n_prime], ny[n_prime], nz[n_prime]);
+        }
+        for (int n_prime = 0; n_prime < N; n_prime += N - 1) {
+            int l = (n_prime - 1) & mask, r = (n_prime + 1) & mask;
+            differenceNormal(spacing2,
+                             h[l],        h[r],        dx[l],        dx[r],        dz[l],        dz[r],
+                             hd[n_prime], hu[n_prime], dxd[n_prime], dxu[n_prime], dzd[n_prime], dzu[n_prime],
+                             nx[n_prime], ny[n_prime], nz[n_prime]);
+        }
+    }
+}
+
+// Evaluates t once with each normal mode and reports the angle between the two
+// normals over the grid. The difference normals follow the horizontal displacement
+// while the FFT slopes do not, so part of the error is the choppiness itself.
+void OceanSimulation::compareNormals(float t, float &max_degrees, float &rms_degrees) {
+    ocean_normal_mode mode = normal_mode;
+    std::vector<float> nx(N*N), ny(N*N), nz(N*N);
+
+    normal_mode = OCEAN_NORMALS_FFT;
+    evaluateWavesFFT(t);
+    std::copy(out_nx, out_nx + N*N, nx.begin());
+    std::copy(out_ny, out_ny + N*N, ny.begin());
+    std::copy(out_nz, out_nz + N*N, nz.begin());
+
+    normal_mode = OCEAN_NORMALS_DIFFERENCE;
+    evaluateWavesFFT(t);
+
+    double sum = 0.0, peak = 0.0;
+    for (int index = 0; index < N*N; index++) {
+        double d = nx[index] * out_nx[index] + ny[index] * out_ny[index] + nz[index] * out_nz[index];
+        double angle = acos(d > 1.0 ? 1.0 : d) * 180.0 / M_PI;
+        sum += angle * angle;
+        if (angle > peak) peak = angle;
+    }
+    max_degrees = (float)peak;
+    rms_degrees = (float)sqrt(sum / (N*N));
+
+    normal_mode = mode;
+}
+
+// plays frames back from bake instead of simulating, null goes back to the FFT. The
+// bake has to match the resolution and the patch length (stored exactly as
+// patchLength() returned it), otherwise its frames would play at the wrong scale.
+bool OceanSimulation::setPlayback(const OceanBake *bake) {
+    if (bake && (bake->resolution() != N || bake->patchLength() != length)) return false;
+    playback = bake;
+    return true;
+}
+
+// the publisher must have been created for this resolution, it is not owned
+bool OceanSimulation::setPublisher(OceanPublisher *shm) {
+    if (shm && shm->resolution() != N) return false;
+    publisher = shm;
+    return true;
+}
+
+// Every omega is a multiple of 2 pi / repeatPeriod(), so the surface at t is the one at
+// t modulo the period. Reducing in double before anything turns t into a float phase
+// keeps hours into a session as exact as the first period, and makes seeking to any
+// t the same frame as running up to it.
+double OceanSimulation::wrapTime(double t) const {
+    double period = repeatPeriod();
+    double r = fmod(t, period);
+    return r < 0.0 ? r + period : r;
+}
+
+void OceanSimulation::evaluate(double time) {
+    TRACE_ZONE("OceanSimulation::evaluate");
+    float t = (float)wrapTime(time);
+    if (!playback) {
+        if (step > 0.0f) {
+            evaluateDecimated(t);
+        } else {
+            simulate(t);
+            markPyramid(out_height, out_dx, out_dz);
+        }
+    } else {
+        playback->evaluate(t, out_height, out_dx, out_dz, out_nx, out_ny, out_nz);
+        markPyramid(out_height, out_dx, out_dz);
+    }
+    if (publisher) publisher->publish(this, t);
+}
+
+struct snapshot_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t texel_size;        // sizeof(complex), catches layout changes
+    int32_t N;
+    uint32_t layers;
+    uint64_t seed;
+    float g, A, wx, wz, length;
+    int32_t normal_mode, wave_model, gerstner_count;
+    float prune_threshold, detail, step;
+    uint32_t reserved0;
+    double time;                // already reduced by wrapTime()
+};
+
+struct snapshot_layer {
+    float A, wx, wz, damping;
+    int32_t spreading;
+};
+
+static const char snapshot_magic[8] = { 'W', 'E', 'T', 'S', 'N', 'A', 'P', 0 };
+static const uint32_t snapshot_version = 1;
+
+// Parameters a snapshot may carry: every float finite, gravity and the patch length
+// positive, amplitudes and the step not negative. Anything else would turn the
+// spectrum or the time into NaN and is refused like a corrupt file.
+static bool validParameters(const snapshot_header &h) {
+    const float values[] = { h.g, h.A, h.wx, h.wz, h.length, h.prune_threshold, h.detail, h.step };
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++)
+        if (!std::isfinite(values[i])) return false;
+    return std::isfinite(h.time) && h.g > 0.0f && h.length > 0.0f && h.A >= 0.0f && h.step >= 0.0f &&
+           h.prune_threshold >= 0.0f;
+}
+
+static bool validLayer(const snapshot_layer &l) {
+    return std::isfinite(l.A) && std::isfinite(l.wx) && std::isfinite(l.wz) && std::isfinite(l.damping) &&
+           l.A >= 0.0f;
+}
+
+// The header holds the seed and every parameter, followed by the layers and the h0
+// tables the frames are built from: h0 and h0mk* ((N+1)^2 each) and, with layers, the
+// base and per layer tables addLayer() keeps. omega is left out, it depends on the
+// length alone and is cheap to recompute. Written to a temporary file and renamed.
+bool OceanSimulation::saveSnapshot(const std::string &path, double t) const {
+    snapshot_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, snapshot_magic, sizeof(snapshot_magic));
+    header.version         = snapshot_version;
+    header.texel_size      = sizeof(complex);
+    header.N               = N;
+    header.layers          = layers.size();
+    header.seed            = seed;
+    header.g               = g;
+    header.A               = A;
+    header.wx              = w.x;
+    header.wz              = w.y;
+    header.length          = length;
+    header.normal_mode     = normal_mode;
+    header.wave_model      = wave_model;
+    header.gerstner_count  = gerstner_count;
+    header.prune_threshold = prune_threshold;
+    header.detail          = detail;
+    header.step            = step;
+    header.time            = wrapTime(t);
+
+    std::string tmp = path + ".tmp";
+    FILE *f = fopen(tmp.c_str(), "wb");
+    if (!f) return false;
+
+    size_t size = (size_t)Nplus1 * Nplus1;
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    for (size_t l = 0; ok && l < layers.size(); l++) {
+        snapshot_layer layer = { layers[l].A, layers[l].w.x, layers[l].w.y, layers[l].damping, layers[l].spreading };
+        ok = fwrite(&layer, sizeof(layer), 1, f) == 1;
+    }
+    ok = ok && fwrite(h0_tk,       sizeof(complex), size, f) == size &&
+               fwrite(h0_tmk_conj, sizeof(complex), size, f) == size;
+    if (!layers.empty()) {
+        ok = ok && fwrite(base_h0, sizeof(complex), 2 * size, f) == 2 * size;
+        for (size_t l = 0; ok && l < layers.size(); l++)
+            ok = fwrite(layer_h0[l], sizeof(complex), 2 * size, f) == 2 * size;
+    }
+    ok = (fclose(f) == 0) && ok;
+
+    if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+        remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Puts the simulation into the saved state and returns the saved time in t. Nothing
+// is redrawn from the random streams, the tables are read back as they were; the
+// resolution has to match. On failure the simulation is left untouched.
+bool OceanSimulation::loadSnapshot(const std::string &path, double &t) {
+    FILE *f = fopen(path.c_str(), "rb");
+    if (!f) return false;
+
+    snapshot_header header;
+    if (fread(&header, sizeof(header), 1, f) != 1 ||
+        memcmp(header.magic, snapshot_magic, sizeof(snapshot_magic)) != 0 ||
+        header.version != snapshot_version || header.texel_size != sizeof(complex) ||
+        header.N != N || header.layers > 1024 || !validParameters(header) ||
+        (header.normal_mode != OCEAN_NORMALS_FFT && header.normal_mode != OCEAN_NORMALS_DIFFERENCE) ||
+        (header.wave_model != OCEAN_WAVES_FFT && header.wave_model != OCEAN_WAVES_GERSTNER)) {
+        fclose(f);
+        return false;
+    }
+
+    // the header decides how much gets allocated, so the file has to be that long first
+    const size_t size = (size_t)Nplus1 * Nplus1;
+    unsigned long long expected = sizeof(header) + (unsigned long long)header.layers * sizeof(snapshot_layer) +
+                                  2ull * size * (header.layers ? header.layers + 2 : 1) * sizeof(complex);
+    long end = fseek(f, 0, SEEK_END) == 0 ? ftell(f) : -1;
+    if (end < 0 || (unsigned long long)end != expected || fseek(f, sizeof(header), SEEK_SET) != 0) {
+        fclose(f);
+        return false;
+    }
+
+    std::vector<snapshot_layer> saved(header.layers);
+    std::vector<complex> tables(2 * size * (header.layers ? header.layers + 2 : 1));
+    bool ok = (saved.empty() || fread(&saved[0], sizeof(snapshot_layer), saved.size(), f) == saved.size()) &&
+              fread(&tables[0], sizeof(complex), tables.size(), f) == tables.size();
+    fclose(f);
+    for (size_t l = 0; ok && l < saved.size(); l++) ok = validLayer(saved[l]);
+    for (size_t i = 0; ok && i < tables.size(); i++) ok = std::isfinite(tables[i].a) && std::isfinite(tables[i].b);
+    if (!ok) return false;
+
+    g      = header.g;
+    A      = header.A;
+    w      = vector2(header.wx, header.wz);
+    length = header.length;
+    seed   = header.seed;
+    if (gaussians) delete [] gaussians;     // drawn from the old seed
+    gaussians = 0;
+
+    for (size_t l = 0; l < layer_h0.size(); l++) delete [] layer_h0[l];
+    layers.clear();
+    layer_h0.clear();
+    if (base_h0) delete [] base_h0;
+    base_h0 = 0;
+
+    std::copy(&tables[0], &tables[0] + size, h0_tk);
+    std::copy(&tables[0] + size, &tables[0] + 2 * size, h0_tmk_conj);
+    if (header.layers) {
+        base_h0 = new complex[2 * size];
+        std::copy(&tables[0] + 2 * size, &tables[0] + 4 * size, base_h0);
+        for (uint32_t l = 0; l < header.layers; l++) {
+            ocean_layer layer;
+            layer.A         = saved[l].A;
+            layer.w         = vector2(saved[l].wx, saved[l].wz);
+            layer.damping   = saved[l].damping;
+            layer.spreading = saved[l].spreading;
+            layers.push_back(layer);
+
+            complex *h0 = new complex[2 * size];
+            std::copy(&tables[0] + (4 + 2 * l) * size, &tables[0] + (6 + 2 * l) * size, h0);
+            layer_h0.push_back(h0);
+        }
+    }
+    Parallel::forEach(0, Nplus1, [this](int begin, int end) {
+        for (int m_prime = begin; m_prime < end; m_prime++) {
+            for (int n_prime = 0; n_prime < Nplus1; n_prime++)
+                omega[m_prime * Nplus1 + n_prime] = dispersion(n_prime, m_prime);
+        }
+    });
+
+    normal_mode = (ocean_normal_mode)header.normal_mode;
+    setDetail(header.detail);
+    setSimulationRate(header.step > 0.0f ? 1.0f : 0.0f);   // allocates the frames
+    step = header.step;                                       // exactly the saved one
+    setPruneThreshold(header.prune_threshold);
+    setWaveModel((ocean_wave_model)header.wave_model, header.gerstner_count);
+    frames_valid = false;
+
+    t = header.time;
+    return true;
+}
+
+// bilinear lookup into a periodic N*N grid, u and v in texels
+static inline float sampleGrid(const float *grid, int N, float u, float v) {
+    float fu = floorf(u), fv = floorf(v);
+    float su = u - fu,    sv = v - fv;
+    int mask = N - 1;
+    int n0 = (int)fu & mask, n1 = (n0 + 1) & mask;
+    int m0 = (int)fv & mask, m1 = (m0 + 1) & mask;
+    float h0 = grid[m0 * N + n0] + (grid[m0 * N + n1] - grid[m0 * N + n0]) * su;
+    float h1 = grid[m1 * N + n0] + (grid[m1 * N + n1] - grid[m1 * N + n0]) * su;
+    return h0 + (h1 - h0) * sv;
+}
+
+// height of the surface that ends up above texel coordinates (u, v). The grid is
+// displaced horizontally, so the texel that lands there is found with a few fixed
+// point iterations u0 = u - D(u0); du and dv receive that displacement in texels.
+float OceanSimulation::surfaceHeight(float u, float v, float &du, float &dv) const {
+    const int iterations = 4;
+    const float scale    = N / length;
+
+    du = dv = 0.0f;
+    for (int j = 0; j < iterations; j++) {
+        float pu = u - du, pv = v - dv;
+        du = sampleGrid(out_dx, N, pu, pv) * scale;
+        dv = sampleGrid(out_dz, N, pu, pv) * scale;
+    }
+    return sampleGrid(out_height, N, u - du, v - dv);
+}
+
+#if defined(__SSE2__)
+// sampleGrid for four points: the sixteen texel fetches stay scalar, the cell and
+// weight arithmetic and the blend run on all four lanes, with the same rounding
+static inline __m128 sampleGrid4(const float *grid, int N, __m128 u, __m128 v) {
+    const __m128 one = _mm_set1_ps(1.0f);
+    __m128 fu = _mm_cvtepi32_ps(_mm_cvttps_epi32(u)), fv = _mm_cvtepi32_ps(_mm_cvttps_epi32(v));
+    fu = _mm_sub_ps(fu, _mm_and_ps(_mm_cmpgt_ps(fu, u), one));     // floor
+    fv = _mm_sub_ps(fv, _mm_and_ps(_mm_cmpgt_ps(fv, v), one));
+    __m128 su = _mm_sub_ps(u, fu), sv = _mm_sub_ps(v, fv);
+
+    int n[4], m[4];
+    _mm_storeu_si128((__m128i *)n, _mm_cvttps_epi32(fu));
+    _mm_storeu_si128((__m128i *)m, _mm_cvttps_epi32(fv));
+    float t00[4], t01[4], t10[4], t11[4];
+    const int mask = N - 1;
+    for (int l = 0; l < 4; l++) {
+        int n0 = n[l] & mask, n1 = (n0 + 1) & mask;
+        int m0 = m[l] & mask, m1 = (m0 + 1) & mask;
+        t00[l] = grid[m0 * N + n0];
+        t01[l] = grid[m0 * N + n1];
+        t10[l] = grid[m1 * N + n0];
+        t11[l] = grid[m1 * N + n1];
+    }
+    __m128 a = _mm_loadu_ps(t00), b = _mm_loadu_ps(t01), c = _mm_loadu_ps(t10), d = _mm_loadu_ps(t11);
+    __m128 h0 = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), su));
+    __m128 h1 = _mm_add_ps(c, _mm_mul_ps(_mm_sub_ps(d, c), su));
+    return _mm_add_ps(h0, _mm_mul_ps(_mm_sub_ps(h1, h0), sv));
+}
+#endif
+
+// Samples the surface produced by the last evaluateWavesFFT at count points given in
+// ocean space (before the model transform of the renderer).
+// dx/dz receive the horizontal displacement of the sampled surface point and may be
+// null. Only reads the output grid, so any number of threads may query concurrently
+// as long as evaluateWavesFFT is not running at the same time. Points go through
+// surfaceHeight four at a time; large batches are split over the worker threads.
+void OceanSimulation::sampleDisplacement(int count, const float *x, const float *z,
+                               float *height, float *dx, float *dz) const {
+    const float scale  = N / length;
+    const float offset = N / 2.0f;
+    const int chunk    = 1024;      // points per work item
+
+    auto sample = [&](int begin, int end) {
+        int i = begin;
+#if defined(__SSE2__)
+        const __m128 vscale = _mm_set1_ps(scale), voffset = _mm_set1_ps(offset);
+        for (; i + 4 <= end; i += 4) {
+            __m128 u = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(x + i), vscale), voffset);
+            __m128 v = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(z + i), vscale), voffset);
+            __m128 du = _mm_setzero_ps(), dv = _mm_setzero_ps();
+            for (int j = 0; j < 4; j++) {       // the fixed point iterations of surfaceHeight
+                __m128 pu = _mm_sub_ps(u, du), pv = _mm_sub_ps(v, dv);
+                du = _mm_mul_ps(sampleGrid4(out_dx, N, pu, pv), vscale);
+                dv = _mm_mul_ps(sampleGrid4(out_dz, N, pu, pv), vscale);
+            }
+            _mm_storeu_ps(height + i, sampleGrid4(out_height, N, _mm_sub_ps(u, du), _mm_sub_ps(v, dv)));
+            if (dx) _mm_storeu_ps(dx + i, _mm_div_ps(du, vscale));
+            if (dz) _mm_storeu_ps(dz + i, _mm_div_ps(dv, vscale));
+        }
+#endif
+        float du, dv;
+        for (; i < end; i++) {
+            height[i] = surfaceHeight(x[i] * scale + offset, z[i] * scale + offset, du, dv);
+            if (dx) dx[i] = du / scale;
+            if (dz) dz[i] = dv / scale;
+        }
+    };
+
+    if (count < 2 * chunk) {
+        sample(0, count);
+        return;
+    }
+    Parallel::forEach(0, (count + chunk - 1) / chunk, [&](int begin, int end) {
+        sample(begin * chunk, std::min(count, end * chunk));
+    });
+}
+
+// Bilinear lookup of the texel values at rest positions (x, z) -- no inversion of the
+// displacement. This is what a mesh that starts out at (x, z) needs: its vertex goes
+// to (x + dx, height, z + dz). dx, dz and the normal arrays may be 0. The same
+// threading rules as sampleDisplacement apply.
+void OceanSimulation::sampleRest(int count, const float *x, const float *z, float *height, float *dx, float *dz,
+                                 float *nx, float *ny, float *nz) const {
+    const float scale  = N / length;
+    const float offset = N / 2.0f;
+
+    for (int i = 0; i < count; i++) {
+        float u = x[i] * scale + offset, v = z[i] * scale + offset;
+        height[i] = sampleGrid(out_height, N, u, v);
+        if (dx) dx[i] = sampleGrid(out_dx, N, u, v);
+        if (dz) dz[i] = sampleGrid(out_dz, N, u, v);
+        if (!nx) continue;
+        float a = sampleGrid(out_nx, N, u, v), b = sampleGrid(out_ny, N, u, v), c = sampleGrid(out_nz, N, u, v);
+        float r = 1.0f / sqrtf(a * a + b * b + c * c);
+        nx[i] = a * r;
+        ny[i] = b * r;
+        nz[i] = c * r;
+    }
+}
+
+// The pyramid is only needed by ray queries, so evaluating a frame just records the
+// grids it covers; the first intersectRays after that builds it. The decimated path
+// marks it once per pair of frames, the blend in between is covered by their span.
+void OceanSimulation::markPyramid(const float *height, const float *dx, const float *dz,
+                                  const float *height1, const float *dx1, const float *dz1) {
+    std::lock_guard<std::mutex> guard(pyramid_lock);
+    pyramid_source[0] = height;
+    pyramid_source[1] = dx;
+    pyramid_source[2] = dz;
+    pyramid_source[3] = height1;
+    pyramid_source[4] = dx1;
+    pyramid_source[5] = dz1;
+    pyramid_dirty = true;
+}
+
+void OceanSimulation::updatePyramid() const {
+    std::lock_guard<std::mutex> guard(pyramid_lock);
+    if (!pyramid_dirty) return;
+    PerfScope stage("pyramid");
+    TRACE_ZONE("pyramid");
+    const float *const *source = pyramid_source;
+    pyramid->build(source[0], source[1], source[2], N / length, source[3], source[4], source[5]);
+    pyramid_dirty = false;
+}
+
+// Intersects count rays (ocean space, like sampleDisplacement) with the surface of
+// the last evaluateWavesFFT. t[i] receives the distance of the first hit in units of
+// the ray direction, or -1 if the surface is not reached within tmax -- so a line of
+// sight test is a ray with tmax set to the target. Rays walk the height pyramid and
+// skip every cell whose highest crest lies below them; level 0 cells the ray may dip
+// into are sampled at substeps points and the crossing refined by false position, so
+// a ray grazing a crest narrower than 1/substeps of a texel can pass through it.
+// Returns the number of hits; thread safety as for sampleDisplacement.
+int OceanSimulation::intersectRays(int count, const ocean_ray *rays, float *t_hit) const {
+    updatePyramid();
+    const int substeps   = 2;
+    const int refine     = 6;
+    const float scale    = N / length;
+    const float offset   = N / 2.0f;
+    const int top        = pyramid->levelCount() - 1;
+    const float *root    = pyramid->cell(top, 0, 0);
+
+    int hits = 0;
+    float sdu, sdv;
+    for (int i = 0; i < count; i++) {
+        const ocean_ray &ray = rays[i];
+        float u0 = ray.ox * scale + offset, du = ray.dx * scale;
+        float v0 = ray.oz * scale + offset, dv = ray.dz * scale;
+
+        // clip to the slab between the lowest trough and the highest crest
+        float t = 0.0f, t_end = ray.tmax;
+        if (ray.dy < 0.0f) {
+            t     = fmaxf(t,     (root[1] - ray.oy) / ray.dy);
+            t_end = fminf(t_end, (root[0] - ray.oy) / ray.dy);
+        } else if (ray.dy > 0.0f) {
+            t_end = fminf(t_end, (root[1] - ray.oy) / ray.dy);
+        } else if (ray.oy > root[1]) {
+            t_end = -1.0f;
+        }
+
+        // small step to get over cell borders
+        float t_step = 1e-3f / fmaxf(fmaxf(fabsf(du), fabsf(dv)), 1e-3f);
+
+        t_hit[i] = -1.0f;
+        if (t > t_end) continue;
+        if (ray.oy + ray.dy * t <= surfaceHeight(u0 + du * t, v0 + dv * t, sdu, sdv)) {
+            t_hit[i] = t;
+            hits++;
+            continue;
+        }
+
+        int level = top;
+        while (t < t_end) {
+            float size = (float)(1 << level);
+            float u = u0 + du * t, v = v0 + dv * t;
+            float cu = floorf(u / size), cv = floorf(v / size);
+
+            float t_exit = t_end;
+            if (du > 0.0f) t_exit = fminf(t_exit, t + ((cu + 1.0f) * size - u) / du);
+            if (du < 0.0f) t_exit = fminf(t_exit, t + (cu * size - u) / du);
+            if (dv > 0.0f) t_exit = fminf(t_exit, t + ((cv + 1.0f) * size - v) / dv);
+            if (dv < 0.0f) t_exit = fminf(t_exit, t + (cv * size - v) / dv);
+
+            const float *bounds = pyramid->cell(level, (int)cu, (int)cv);
+            float y_low = ray.oy + ray.dy * (ray.dy < 0.0f ? t_exit : t);
+
+            if (y_low > bounds[1]) {            // passes above everything in this cell
+                t = t_exit + t_step;
+                if (level < top) level++;
+            } else if (level > 0) {
+                level--;
+            } else {                            // step through the cell, refine the crossing
+                float a = t, b = t;
+                float fa = 0.0f, fb = ray.oy + ray.dy * t - surfaceHeight(u0 + du * t, v0 + dv * t, sdu, sdv);
+                for (int j = 1; j <= substeps && fb > 0.0f; j++) {
+                    a  = b;
+                    fa = fb;
+                    b  = t + (t_exit - t) * j / substeps;
+                    fb = ray.oy + ray.dy * b - surfaceHeight(u0 + du * b, v0 + dv * b, sdu, sdv);
+                }
+                if (fb <= 0.0f) {
+                    int side = 0;
+                    for (int j = 0; j < refine; j++) {    // false position, illinois variant
+                        float c  = a + (b - a) * fa / (fa - fb);
+                        float fc = ray.oy + ray.dy * c - surfaceHeight(u0 + du * c, v0 + dv * c, sdu, sdv);
+                        if (fc <= 0.0f) {
+                            b = c; fb = fc;
+                            if (side == -1) fa *= 0.5f;
+                            side = -1;
+                        } else {
+                            a = c; fa = fc;
+                            if (side == 1) fb *= 0.5f;
+                            side = 1;
+                        }
+                    }
+                    t_hit[i] = b;
+                    hits++;
+                    break;
+                }
+                t = t_exit + t_step;
+            }
+        }
+    }
+    return hits;
+}
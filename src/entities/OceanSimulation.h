@@ -0,0 +1,224 @@
+#ifndef OCEANSIMULATION_H
+#define OCEANSIMULATION_H
+
+#include <stdint.h>
+#include <vector>
+#include <mutex>
+#include "Complex.h"
+#include "vector.h"
+#include "fft.h"
+#include "HeightPyramid.h"
+#include "SpectrumCache.h"
+#include "OceanBake.h"
+#include "OceanPublisher.h"
+#include "Arena.h"
+
+
+struct ocean_ray {             // ray in ocean space, hits are reported as distances along d
+    float ox, oy, oz;           // origin
+    float dx, dy, dz;           // direction
+    float tmax;                 // farthest distance of interest
+};
+
+
+
+
+enum ocean_normal_mode {
+    OCEAN_NORMALS_FFT,          // slopes from two extra inverse FFTs
+    OCEAN_NORMALS_DIFFERENCE    // central differences over the displaced grid
+};
+
+
+
+
+struct ocean_layer {            // one spectrum layer, see addLayer()
+    float A;                    // phillips amplitude
+    vector2 w;                  // wind velocity: direction and peak wavelength
+    float damping;              // suppresses wavelengths below damping * w^2 / g, 0.001 for the base layer
+    int spreading;              // exponent of k.w, higher is more directional, 6 for the base layer
+};
+
+
+
+
+enum ocean_wave_model {
+    OCEAN_WAVES_FFT,            // every spectrum bin through the inverse FFT
+    OCEAN_WAVES_GERSTNER        // direct sum of the strongest bins as Gerstner waves
+};
+
+
+
+
+struct gerstner_wave {          // one spectrum bin as a travelling wave
+    float kz, omega, phase;     // theta = kx * x + kz * z + omega * t + phase
+    float a;                    // height amplitude
+    float a_dx, a_dz;           // displacement amplitudes, lambda included
+    float a_kx, a_kz;           // slope amplitudes
+};
+
+
+
+
+struct ocean_prune_stats {     // what setPruneThreshold() dropped and what it costs
+    float bins_kept;            // fraction of spectrum bins still transformed
+    float work_saved;           // fraction of FFT twiddle multiplies the last evaluateWavesFFT skipped (pruning and LOD)
+    float height_error;         // bound on the height and displacement error of any texel
+    float slope_error;          // bound on the slope error of any texel
+};
+
+
+
+
+struct ocean_reference_error {  // FFT path against the direct sum, see compareReference()
+    float height_max, height_rms;
+    float displacement_max, displacement_rms;   // length of the horizontal difference
+    float normal_max_degrees, normal_rms_degrees;
+};
+
+
+
+
+struct complex_vector_normal {  // structure used with discrete fourier transform
+    complex h;      // wave height
+    vector2 D;      // displacement
+    vector3 n;      // normal
+};
+
+
+
+
+// FFT ocean simulation without any dependency on OpenGL. Every evaluateWaves*
+// call leaves one N*N frame in the output grids: the height, the horizontal
+// displacement and the normal of each texel. Texel (n', m') rests at
+// ((n' - N/2) * length / N, (m' - N/2) * length / N) in ocean space. evaluate() runs
+// the selected wave model (FFT or Gerstner), blends two such frames when a simulation
+// rate is set, or plays back a baked period when one has been set. Every frame is a
+// function of t modulo repeatPeriod(), see wrapTime().
+class OceanSimulation {
+  private:
+    float g;                // gravity constant
+    int N, Nplus1;              // dimension -- N should be a power of 2
+    float A;                // phillips spectrum parameter -- affects heights of waves
+    vector2 w;              // wind parameter
+    float length;               // length parameter
+    uint64_t seed;              // random seed of the initial spectrum
+    Arena *arena;               // fixed size buffers below, see the constructor
+
+    complex *h0_tk, *h0_tmk_conj;   // initial spectrum, (N+1)*(N+1)
+    float *omega;               // dispersion of every texel
+    SpectrumCache *spectrum;        // owns the tables above when they were loaded from disk
+    complex *base_h0;               // base layer h0 then h0mk*, 2 * (N+1)^2, kept while layers are added
+    std::vector<ocean_layer> layers;    // extra layers on top of the base spectrum
+    std::vector<complex*> layer_h0;     // their h0 then h0mk*, 2 * (N+1)^2 each
+    complex *gaussians;             // base layer draws behind h0 then h0mk*, kept after the first set*()
+
+    complex *h_tilde,           // for fast fourier transform
+        *h_tilde_slopex, *h_tilde_slopez,
+        *h_tilde_dx, *h_tilde_dz;
+    std::vector<cFFT*> ffts[3];     // N, N/2 and N/4 transforms, one per slice of the FFT passes
+
+    float *out_height,          // output grids, N*N
+        *out_dx, *out_dz,
+        *out_nx, *out_ny, *out_nz;
+    HeightPyramid *pyramid;         // min/max bounds of out_height for ray queries
+    const float *pyramid_source[6]; // height, dx, dz of one or two frames it is built from
+    mutable bool pyramid_dirty;     // sources changed since the last build
+    mutable std::mutex pyramid_lock;
+    const OceanBake *playback;      // when set, evaluate() plays frames back from it
+    OceanPublisher *publisher;      // when set, evaluate() hands every frame to it
+    ocean_normal_mode normal_mode;
+    unsigned char *prune_mask;      // N*N in FFT order: bin is transformed, 0 when not pruning
+    unsigned char *prune_rows;      // N: row has any transformed bin
+    ocean_prune_stats prune_stats;
+    float prune_threshold;
+    float detail;                   // spectral LOD, see setDetail()
+    complex *lod_tilde[2][5];       // h, slopex, slopez, dx, dz of the N/2 and N/4 levels, allocated on first use
+    float step;                     // time between simulated frames, 0 simulates every evaluate()
+    float *frames[2][6];            // height, dx, dz, nx, ny, nz of steps frame_index and frame_index + 1
+    int frame_index;
+    bool frames_valid;
+    ocean_wave_model wave_model;
+    int gerstner_count;
+    gerstner_wave *gerstner_waves;
+    float *gerstner_basis;          // per wave cos and sin of kx * x along a row, 2 * N each
+
+    void differenceNormals();
+    void markPyramid(const float *height, const float *dx, const float *dz,
+                     const float *height1 = 0, const float *dx1 = 0, const float *dz1 = 0);
+    void updatePyramid() const;
+    ocean_layer baseLayer() const;
+    float phillips(int n_prime, int m_prime, const ocean_layer &layer);
+    complex hTilde_0(int n_prime, int m_prime, unsigned int stream, const ocean_layer &layer);
+    void fillLayer(int l);
+    void combineLayers();
+    void rescaleSpectrum(bool dispersion_changed);
+    void spectrumChanged();
+    cFFT *const *transforms(int level, int slices);
+    void transformSpectrum(float t, int level, complex *const *tilde,
+                           bool slopes, const unsigned char *prune, const unsigned char *rows);
+    void evaluateLevel(float t, int level, float weight, bool slopes);
+    void simulate(float t);
+    void simulateFFT(float t);
+    void simulateGerstner(float t);
+    void simulateStep(int k, int slot);
+    void evaluateDecimated(float t);
+
+    float surfaceHeight(float u, float v, float &du, float &dv) const;
+
+  protected:
+  public:
+    OceanSimulation(const int N, const float A, const vector2 w, const float length,
+                    const uint64_t seed = 1, const char *cache_dir = 0,
+                    arena_pages pages = ARENA_PAGES_DEFAULT);
+    ~OceanSimulation();
+
+    float dispersion(int n_prime, int m_prime);     // deep water
+    float phillips(int n_prime, int m_prime);       // phillips spectrum
+    complex hTilde_0(int n_prime, int m_prime, unsigned int stream = 0);
+    complex hTilde(float t, int n_prime, int m_prime);
+    int addLayer(const ocean_layer &layer);
+    bool setLayer(int index, const ocean_layer &layer);
+    void clearLayers();
+    void setWind(const vector2 wind);
+    void setAmplitude(const float amplitude);
+    void setLength(const float patch_length);
+    int layerCount() const { return (int)layers.size(); }
+    complex_vector_normal h_D_and_n(vector2 x, float t);
+    void evaluateWaves(float t);
+    void evaluateWavesFFT(float t);
+    void evaluateWavesGerstner(float t);
+    void setWaveModel(ocean_wave_model model, int waves = 64);
+    void setNormalMode(ocean_normal_mode mode);
+    void compareNormals(float t, float &max_degrees, float &rms_degrees);
+    void compareReference(float t, ocean_reference_error &error);
+    void setPruneThreshold(float relative_energy);
+    const ocean_prune_stats& pruneStats() const { return prune_stats; }
+    void setDetail(float level);
+    float detailLevel() const { return detail; }
+    void setSimulationRate(float hz);
+    bool setPlayback(const OceanBake *bake);
+    bool setPublisher(OceanPublisher *publisher);
+    double wrapTime(double t) const;
+    void evaluate(double t);
+    bool saveSnapshot(const std::string &path, double t) const;
+    bool loadSnapshot(const std::string &path, double &t);
+    void sampleRest(int count, const float *x, const float *z, float *height, float *dx, float *dz,
+                    float *nx = 0, float *ny = 0, float *nz = 0) const;
+    void sampleDisplacement(int count, const float *x, const float *z,
+                            float *height, float *dx = 0, float *dz = 0) const;
+    int intersectRays(int count, const ocean_ray *rays, float *t) const;
+
+    int resolution() const { return N; }
+    float patchLength() const { return length; }
+    arena_pages pageBacking() const { return arena->backing(); }
+    float repeatPeriod() const { return 200.0f; }   // dispersion is quantized to 2 pi / period
+    const float* height() const { return out_height; }
+    const float* displacementX() const { return out_dx; }
+    const float* displacementZ() const { return out_dz; }
+    const float* normalX() const { return out_nx; }
+    const float* normalY() const { return out_ny; }
+    const float* normalZ() const { return out_nz; }
+};
+
+
+#endif
@@ -0,0 +1,145 @@
+#include "OceanTessellation.h"
+#include "Trace.h"
+
+// Patch corners are stored in patch lengths so a setLength() on the simulation needs
+// no rebuild; the vertex stage scales them. Tile (i, j) of OceanRenderer spans
+// [i - 1/2, i + 1/2] x [-j - 1/2, -j + 1/2], the corners cover all 10x10 of them.
+OceanTessellation::OceanTessellation(const OceanSimulation *simulation, int patches) :
+    simulation(simulation), N(simulation->resolution()), patches(patches),
+    columns(10 * patches + 1), texels(0), arena(0)
+{
+    int cells = columns - 1;
+    indices_count = 4 * cells * cells;
+    arena  = new Arena(Arena::blockSize(sizeof(float) * 8 * N * N) +
+                       Arena::blockSize(sizeof(GLfloat) * 2 * columns * columns) +
+                       Arena::blockSize(sizeof(unsigned int) * indices_count),
+                       simulation->pageBacking());
+    texels = arena->take<float>(8 * N * N);
+    GLfloat *corners      = arena->take<GLfloat>(2 * columns * columns);
+    unsigned int *indices = arena->take<unsigned int>(indices_count);
+
+    for (int m = 0; m < columns; m++) {
+        for (int n = 0; n < columns; n++) {
+            corners[2 * (m * columns + n)]     = -0.5f + (float)n / patches;
+            corners[2 * (m * columns + n) + 1] =  0.5f - (float)m / patches;
+        }
+    }
+    unsigned int *p = indices;
+    for (int m = 0; m < cells; m++) {
+        for (int n = 0; n < cells; n++) {
+            unsigned int index = m * columns + n;
+            *p++ = index;                   // (0,0) (1,0) (1,1) (0,1)
+            *p++ = index + 1;
+            *p++ = index + columns + 1;
+            *p++ = index + columns;
+        }
+    }
+
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+
+    glGenBuffers(1, &vbo_vertices);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_vertices);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * 2 * columns * columns, corners, GL_STATIC_DRAW);
+
+    glGenBuffers(1, &vbo_indices);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbo_indices);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * indices_count, indices, GL_STATIC_DRAW);
+
+    glBindVertexArray(0);
+
+    // the surface repeats with the patch, so do the textures
+    glGenTextures(2, textures);
+    for (int i = 0; i < 2; i++) {
+        glBindTexture(GL_TEXTURE_2D, textures[i]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, N, N, 0, GL_RGBA, GL_FLOAT, 0);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+OceanTessellation::~OceanTessellation() {
+    if (arena) delete arena;
+}
+
+void OceanTessellation::release() {
+    glDeleteTextures(2, textures);
+    glDeleteBuffers(1, &vbo_indices);
+    glDeleteBuffers(1, &vbo_vertices);
+    glDeleteVertexArrays(1, &vao);
+}
+
+// tessellation shaders are core in 4.0; llvmpipe offers 4.5 core, drivers that stop at
+// 3.3 (or Mesa with MESA_GL_VERSION_OVERRIDE=3.3) keep the tiles
+bool OceanTessellation::supported() {
+    return GLEW_VERSION_4_0 || GLEW_ARB_tessellation_shader;
+}
+
+void OceanTessellation::enableAttribs(GLint vertex) {
+    glBindVertexArray(vao);
+    glEnableVertexAttribArray(vertex);
+    glVertexAttribPointer(vertex, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), 0);
+    glBindVertexArray(0);
+}
+
+// interleaves the last simulation frame into RGBA texels and updates both textures
+void OceanTessellation::upload() {
+    TRACE_ZONE("OceanTessellation::upload");
+    const float *height = simulation->height();
+    const float *dx = simulation->displacementX(), *dz = simulation->displacementZ();
+    const float *nx = simulation->normalX(), *ny = simulation->normalY(), *nz = simulation->normalZ();
+    float *d = texels, *n = texels + 4 * N * N;
+
+    for (int i = 0; i < N * N; i++) {
+        d[4 * i]     = dx[i];
+        d[4 * i + 1] = height[i];
+        d[4 * i + 2] = dz[i];
+        d[4 * i + 3] = 0.0f;
+        n[4 * i]     = nx[i];
+        n[4 * i + 1] = ny[i];
+        n[4 * i + 2] = nz[i];
+        n[4 * i + 3] = 0.0f;
+    }
+    for (int i = 0; i < 2; i++) {
+        glBindTexture(GL_TEXTURE_2D, textures[i]);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, N, N, GL_RGBA, GL_FLOAT, texels + 4 * N * N * i);
+    }
+}
+
+// The caller has set view, projection and light_position and bound the skybox to
+// unit 0; the displacement and normal textures go to units 1 and 2.
+void OceanTessellation::render(ogl::Program* oceanShader, const glm::vec2 &viewport, float edge_pixels) {
+    TRACE_ZONE("OceanTessellation::render");
+    float length = simulation->patchLength();
+
+    glActiveTexture(GL_TEXTURE1);
+    upload();
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, textures[1]);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, textures[0]);
+    glActiveTexture(GL_TEXTURE0);
+
+    oceanShader->setUniform("model", glm::scale(glm::mat4(1.0f), glm::vec3(5.f, 5.f, 5.f)));
+    oceanShader->setUniform("displacement", 1);
+    oceanShader->setUniform("normals", 2);
+    oceanShader->setUniform("patch_length", length);
+    oceanShader->setUniform("texel_offset", 0.5f + 0.5f / N, 0.5f + 0.5f / N);
+    oceanShader->setUniform("viewport", viewport.x, viewport.y);
+    oceanShader->setUniform("edge_pixels", edge_pixels);
+    oceanShader->setUniform("margin", length / patches);
+
+    glBindVertexArray(vao);
+    glPatchParameteri(GL_PATCH_VERTICES, 4);
+    glDrawElements(GL_PATCHES, indices_count, GL_UNSIGNED_INT, 0);
+    glBindVertexArray(0);
+
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+}
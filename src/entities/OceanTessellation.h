@@ -0,0 +1,42 @@
+#ifndef OCEANTESSELLATION_H
+#define OCEANTESSELLATION_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include "../ogl/Program.h"
+#include "OceanSimulation.h"
+
+
+// Draws the same 10x10 tile area as OceanRenderer from a coarse grid of quad patches
+// that the GL 4 tessellation stages refine by projected edge length and displace from
+// the simulation frame, uploaded as two periodic float textures. Needs GL 4.0 or
+// ARB_tessellation_shader; check supported() and keep OceanRenderer as the fallback.
+class OceanTessellation {
+  private:
+    const OceanSimulation *simulation;
+    int N;                          // dimension of the simulation
+    int patches;                    // coarse patches per tile side
+    int columns;                    // patch corners per side of the whole area
+    unsigned int indices_count;
+    float *texels;                  // dx, height, dz, - then nx, ny, nz, - per texel
+    Arena *arena;
+    GLuint textures[2];             // displacement, normals
+    GLuint vbo_vertices, vbo_indices, vao;
+
+    void upload();
+
+  protected:
+  public:
+    OceanTessellation(const OceanSimulation *simulation, int patches = 4);
+    ~OceanTessellation();
+    void release();
+
+    static bool supported();
+
+    void enableAttribs(GLint vertex);
+    void render(ogl::Program* shader, const glm::vec2 &viewport, float edge_pixels = 8.0f);
+};
+
+
+#endif
@@ -0,0 +1,134 @@
+#include "Parallel.h"
+#include "Trace.h"
+#include <stdio.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace {
+    struct Pool {
+        std::vector<std::thread> workers;
+        std::mutex busy;                // held by the thread dispatching a job
+        std::mutex lock;
+        std::condition_variable wake, done;
+
+        unsigned int generation;        // bumped for every job
+        int pending;                    // chunks still running
+        bool quit;
+
+        int begin, end, chunks;
+        void (*fn)(void *, int, int);
+        void *context;
+
+        Pool() : generation(0), pending(0), quit(false), begin(0), end(0), chunks(0), fn(0), context(0) { }
+        ~Pool() { resize(0); }
+
+        void chunk(int i, int &b, int &e) const {
+            int count = end - begin;
+            b = begin + (int)((long long)count * i / chunks);
+            e = begin + (int)((long long)count * (i + 1) / chunks);
+        }
+
+        void work(int id, unsigned int seen);
+        void resize(int count);
+    };
+
+    Pool pool;
+    int requested = 0;
+    thread_local bool inside = false;
+
+    // seen is the generation at spawn, a new worker must not pick up the job before it
+    void Pool::work(int id, unsigned int seen) {
+        inside = true;
+#ifdef OCEAN_TRACE
+        char name[32];
+        snprintf(name, sizeof(name), "worker %d", id);
+        TRACE_THREAD(name);
+#endif
+        for (;;) {
+            int b, e;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                wake.wait(guard, [&] { return quit || generation != seen; });
+                if (quit) return;
+                seen = generation;
+                if (id >= chunks) continue;
+                chunk(id, b, e);
+            }
+            {
+                TRACE_ZONE("parallel chunk");
+                fn(context, b, e);
+            }
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                if (--pending == 0) done.notify_one();
+            }
+        }
+    }
+
+    // worker ids start at 1, chunk 0 belongs to the dispatching thread
+    void Pool::resize(int count) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            quit = true;
+        }
+        wake.notify_all();
+        for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+        workers.clear();
+        std::lock_guard<std::mutex> guard(lock);
+        quit = false;
+        for (int i = 1; i < count; i++) workers.push_back(std::thread(&Pool::work, this, i, generation));
+    }
+}
+
+void Parallel::setThreads(int threads) {
+    std::lock_guard<std::mutex> guard(pool.busy);
+    requested = threads;
+    pool.resize(Parallel::threads());
+}
+
+int Parallel::threads() {
+    if (requested > 0) return requested;
+    int hardware = (int)std::thread::hardware_concurrency();
+    return hardware > 0 ? hardware : 1;
+}
+
+void Parallel::run(int begin, int end, chunk_fn fn, void *context) {
+    if (end <= begin) return;
+
+    std::unique_lock<std::mutex> busy(pool.busy, std::defer_lock);
+    if (inside || threads() == 1 || end - begin == 1 || !busy.try_lock()) {
+        fn(context, begin, end);
+        return;
+    }
+    if ((int)pool.workers.size() + 1 != threads()) pool.resize(threads());
+
+    int b, e;
+    {
+        std::lock_guard<std::mutex> guard(pool.lock);
+        pool.begin   = begin;
+        pool.end     = end;
+        pool.chunks  = end - begin < threads() ? end - begin : threads();
+        pool.fn      = fn;
+        pool.context = context;
+        pool.pending = pool.chunks - 1;
+        pool.generation++;
+        pool.chunk(0, b, e);
+    }
+    pool.wake.notify_all();
+
+    inside = true;
+    {
+        TRACE_ZONE("parallel chunk");
+        fn(context, b, e);
+    }
+    inside = false;
+
+    TRACE_ZONE("parallel wait");
+    std::unique_lock<std::mutex> guard(pool.lock);
+    pool.done.wait(guard, [] { return pool.pending == 0; });
+    pool.fn      = 0;           // the job's context lives on this stack frame
+    pool.context = 0;
+    pool.chunks  = 0;
+}
@@ -0,0 +1,29 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+// Small persistent worker pool. forEach splits [begin, end) into one contiguous
+// chunk per thread and runs them concurrently, the calling thread takes the first
+// chunk. Calls made from inside a chunk, or while another thread is using the
+// pool, run serially on the calling thread.
+class Parallel {
+  private:
+    typedef void (*chunk_fn)(void *context, int begin, int end);
+    static void run(int begin, int end, chunk_fn fn, void *context);
+
+    template <class F>
+    static void trampoline(void *context, int begin, int end) {
+        (*(F*)context)(begin, end);
+    }
+
+  protected:
+  public:
+    static void setThreads(int threads);    // 0 -- one per hardware thread
+    static int threads();
+
+    template <class F>
+    static void forEach(int begin, int end, F f) {
+        run(begin, end, &trampoline<F>, &f);
+    }
+};
+
+#endif
@@ -0,0 +1,135 @@
+#include "PerfCounters.h"
+#include <string.h>
+#include <errno.h>
+#include <chrono>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+namespace {
+    thread_local PerfStages *installed = 0;
+
+    struct event_config {
+        uint32_t type;
+        uint64_t config;
+        const char *name;
+    };
+
+    const uint64_t cache_read_miss = (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+
+    const event_config events[PERF_EVENTS] = {
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES,                  "cycles" },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS,                "instructions" },
+        { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D  | cache_read_miss, "L1d misses" },
+        { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL   | cache_read_miss, "LLC misses" },
+        { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | cache_read_miss, "dTLB misses" },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES,               "branch misses" },
+    };
+}
+
+PerfCounters::PerfCounters() : error(0) {
+    for (int e = 0; e < PERF_EVENTS; e++) fd[e] = -1;
+}
+
+PerfCounters::~PerfCounters() {
+    close();
+}
+
+// user space of this thread on any CPU; that is allowed up to perf_event_paranoid 2
+bool PerfCounters::open() {
+    close();
+    error = 0;
+    for (int e = 0; e < PERF_EVENTS; e++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size           = sizeof(attr);
+        attr.type           = events[e].type;
+        attr.config         = events[e].config;
+        attr.disabled       = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv     = 1;
+        attr.read_format    = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        fd[e] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        if (fd[e] < 0) {
+            if (!error) error = errno;
+            continue;
+        }
+        ioctl(fd[e], PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd[e], PERF_EVENT_IOC_ENABLE, 0);
+    }
+    return any();
+}
+
+void PerfCounters::close() {
+    for (int e = 0; e < PERF_EVENTS; e++) {
+        if (fd[e] >= 0) ::close(fd[e]);
+        fd[e] = -1;
+    }
+}
+
+bool PerfCounters::any() const {
+    for (int e = 0; e < PERF_EVENTS; e++)
+        if (fd[e] >= 0) return true;
+    return false;
+}
+
+void PerfCounters::read(perf_sample &sample) const {
+    sample.ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    for (int e = 0; e < PERF_EVENTS; e++) {
+        uint64_t value[3];      // count, time enabled, time running
+        sample.count[e] = 0;
+        if (fd[e] < 0 || ::read(fd[e], value, sizeof(value)) != sizeof(value)) continue;
+        if (value[2] && value[2] < value[1]) value[0] = (uint64_t)((double)value[0] * value[1] / value[2]);
+        sample.count[e] = value[0];
+    }
+}
+
+const char* PerfCounters::name(perf_event e) {
+    return events[e].name;
+}
+
+
+PerfStages::PerfStages() : count(0) { }
+
+PerfStages::~PerfStages() {
+    uninstall();
+}
+
+bool PerfStages::install() {
+    installed = this;
+    reset();
+    return counters.open();
+}
+
+void PerfStages::uninstall() {
+    if (installed == this) installed = 0;
+    counters.close();
+}
+
+void PerfStages::reset() {
+    count = 0;
+}
+
+// Stage names are string literals, so the pointer nearly always matches; strcmp
+// catches the same name written in two translation units.
+void PerfStages::add(const char *name, const perf_sample &begin, const perf_sample &end) {
+    int i = 0;
+    while (i < count && stages[i].name != name && strcmp(stages[i].name, name)) i++;
+    if (i == count) {
+        if (count == max_stages) return;
+        memset(&stages[i], 0, sizeof(stages[i]));
+        stages[i].name = name;
+        count++;
+    }
+    perf_stage &stage = stages[i];
+    stage.calls++;
+    stage.total.ns += end.ns - begin.ns;
+    for (int e = 0; e < PERF_EVENTS; e++)       // scaled counts can step back a little
+        if (end.count[e] > begin.count[e]) stage.total.count[e] += end.count[e] - begin.count[e];
+}
+
+PerfStages* PerfStages::current() {
+    return installed;
+}
@@ -0,0 +1,101 @@
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+#include <stdint.h>
+
+enum perf_event {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_L1D_MISSES,            // L1 data read misses
+    PERF_LLC_MISSES,            // last level cache read misses
+    PERF_DTLB_MISSES,           // data TLB read misses
+    PERF_BRANCH_MISSES,
+    PERF_EVENTS
+};
+
+struct perf_sample {
+    double ns;                  // steady clock
+    uint64_t count[PERF_EVENTS];
+};
+
+// Hardware counters of the calling thread through perf_event_open, user space only.
+// Every event is opened on its own so one the CPU or the kernel refuses (VMs,
+// containers, perf_event_paranoid) does not take the others with it; a closed event
+// reads as 0 and available() tells it apart from a real 0. Multiplexed events are
+// scaled up to the time they were enabled.
+class PerfCounters {
+  private:
+    int fd[PERF_EVENTS];
+    int error;                  // errno of the first event that failed to open
+
+  protected:
+  public:
+    PerfCounters();
+    ~PerfCounters();
+
+    bool open();                // true if at least one event counts
+    void close();
+    bool available(perf_event e) const { return fd[e] >= 0; }
+    bool any() const;
+    int openError() const { return error; }
+    void read(perf_sample &sample) const;
+
+    static const char* name(perf_event e);
+};
+
+struct perf_stage {
+    const char *name;
+    int calls;
+    perf_sample total;          // summed over the calls
+};
+
+// Per stage totals for one thread. While a PerfStages is installed on a thread, each
+// PerfScope that thread enters adds its time and counter deltas to the stage of the
+// same name. With none installed a scope costs one thread local load and a branch.
+// Work a stage hands to Parallel's workers is in its time but not in its counts.
+class PerfStages {
+  private:
+    static const int max_stages = 16;   // further names are not recorded
+    PerfCounters counters;
+    perf_stage stages[max_stages];
+    int count;
+
+  protected:
+  public:
+    PerfStages();
+    ~PerfStages();
+
+    bool install();             // on the calling thread; false if no counter is available
+    void uninstall();
+    void reset();
+
+    int size() const { return count; }
+    const perf_stage& stage(int i) const { return stages[i]; }
+    const PerfCounters& events() const { return counters; }
+
+    void read(perf_sample &sample) const { counters.read(sample); }
+    void add(const char *name, const perf_sample &begin, const perf_sample &end);
+
+    static PerfStages* current();
+};
+
+class PerfScope {
+  private:
+    PerfStages *stages;
+    const char *name;
+    perf_sample begin;
+
+  protected:
+  public:
+    PerfScope(const char *name) : stages(PerfStages::current()), name(name) {
+        if (stages) stages->read(begin);
+    }
+    ~PerfScope() {
+        if (!stages) return;
+        perf_sample end;
+        stages->read(end);
+        stages->add(name, begin, end);
+    }
+};
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef PHILOX_H
+#define PHILOX_H
+
+#include <stdint.h>
+
+// Philox4x32-10 counter based generator (Salmon et al., "Parallel random numbers:
+// as easy as 1, 2, 3"). Every (counter, key) pair maps to four independent 32 bit
+// words, so any element of a stream can be drawn directly, from any thread, and
+// comes out the same on every host.
+
+static inline void philox4x32(const uint32_t counter[4], const uint32_t key[2], uint32_t out[4]) {
+    const uint32_t M0 = 0xD2511F53, M1 = 0xCD9E8D57;
+    const uint32_t W0 = 0x9E3779B9, W1 = 0xBB67AE85;
+
+    uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+    uint32_t k0 = key[0], k1 = key[1];
+    for (int round = 0; round < 10; round++) {
+        uint64_t p0 = (uint64_t)M0 * c0;
+        uint64_t p1 = (uint64_t)M1 * c2;
+        uint32_t hi0 = (uint32_t)(p0 >> 32), lo0 = (uint32_t)p0;
+        uint32_t hi1 = (uint32_t)(p1 >> 32), lo1 = (uint32_t)p1;
+        c0 = hi1 ^ c1 ^ k0;
+        c1 = lo1;
+        c2 = hi0 ^ c3 ^ k1;
+        c3 = lo0;
+        k0 += W0;
+        k1 += W1;
+    }
+    out[0] = c0; out[1] = c1; out[2] = c2; out[3] = c3;
+}
+
+// 24 random bits to a float in [0, 1), exact in single precision
+static inline float philoxUniform(uint32_t x) {
+    return (float)(x >> 8) * (1.0f / 16777216.0f);
+}
+
+#endif
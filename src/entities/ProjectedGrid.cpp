@@ -0,0 +1,164 @@
+#include "ProjectedGrid.h"
+#include "Parallel.h"
+#include "Trace.h"
+
+// point on the NDC ray (x, y) at depth z, in model space
+static inline glm::vec3 unproject(const glm::mat4 &inverse, float x, float y, float z) {
+    glm::vec4 p = inverse * glm::vec4(x, y, z, 1.0f);
+    return glm::vec3(p.x, p.y, p.z) / p.w;
+}
+
+// Intersects the view ray through NDC (x, y) with the plane y = 0 between the near and
+// far planes. Rays that miss are pinned to their far point dropped onto the plane.
+static inline bool planeHit(const glm::mat4 &inverse, float x, float y, glm::vec3 &hit) {
+    glm::vec3 near = unproject(inverse, x, y, -1.0f);
+    glm::vec3 far  = unproject(inverse, x, y,  1.0f);
+
+    if ((near.y > 0.0f) == (far.y > 0.0f)) {
+        hit = glm::vec3(far.x, 0.0f, far.z);
+        return false;
+    }
+    float t = near.y / (near.y - far.y);
+    hit = near + t * (far - near);
+    hit.y = 0.0f;
+    return true;
+}
+
+ProjectedGrid::ProjectedGrid(const OceanSimulation *simulation, int grid, float scale) :
+    simulation(simulation), grid(grid), Gplus1(grid+1), scale(scale), margin(0.1f),
+    vertices(0), rest_x(0), rest_z(0), samples(0), arena(0), visible(false)
+{
+    int count = Gplus1 * Gplus1;
+    arena    = new Arena(Arena::blockSize(sizeof(vertex_ocean) * count) +
+                         2 * Arena::blockSize(sizeof(float) * count) +
+                         Arena::blockSize(sizeof(float) * 6 * count),
+                         simulation->pageBacking());
+    vertices = arena->take<vertex_ocean>(count);
+    rest_x   = arena->take<float>(count);
+    rest_z   = arena->take<float>(count);
+    samples  = arena->take<float>(6 * count);
+
+    OceanIndices surface(grid, INDEX_STRIPS, INDEX_BLOCKS);
+    index_type    = surface.wideIndices() ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;
+    restart_index = surface.restartIndex();
+    indices_count = surface.indexCount();
+
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+
+    glGenBuffers(1, &vbo_vertices);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_vertices);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertex_ocean) * count, 0, GL_STREAM_DRAW);
+
+    glGenBuffers(1, &vbo_indices);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbo_indices);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, surface.bytes(), surface.data(), GL_STATIC_DRAW);
+
+    glBindVertexArray(0);
+}
+
+ProjectedGrid::~ProjectedGrid() {
+    if (arena) delete arena;
+}
+
+void ProjectedGrid::release() {
+    glDeleteBuffers(1, &vbo_indices);
+    glDeleteBuffers(1, &vbo_vertices);
+    glDeleteVertexArrays(1, &vao);
+}
+
+void ProjectedGrid::enableAttribs(GLint vertex, GLint normal) {
+    glBindVertexArray(vao);
+    glEnableVertexAttribArray(vertex);
+    glVertexAttribPointer(vertex, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_ocean), 0);
+
+    glEnableVertexAttribArray(normal);
+    glVertexAttribPointer(normal, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_ocean), (char *)NULL + 12);
+
+    glBindVertexArray(0);
+}
+
+// Lays the grid over the part of the screen that sees water and drops every vertex
+// onto the plane. The camera never rolls, so the horizon is a horizontal line in NDC
+// and a bisection down the centre column finds it. The range is widened by margin
+// so displaced waves near the screen edges are not cut off.
+bool ProjectedGrid::project(const glm::mat4 &inverse) {
+    glm::vec3 hit;
+    float y0 = -1.0f - margin, y1 = 1.0f + margin;
+    bool low  = planeHit(inverse, 0.0f, y0, hit);
+    bool high = planeHit(inverse, 0.0f, y1, hit);
+
+    if (!low && !high) return false;
+    if (low != high) {
+        float a = y0, b = y1;               // a hits iff low does
+        for (int i = 0; i < 24; i++) {
+            float c = 0.5f * (a + b);
+            if (planeHit(inverse, 0.0f, c, hit) == low) a = c;
+            else                                         b = c;
+        }
+        if (low) y1 = a;
+        else     y0 = a;
+    }
+
+    const float x0 = -1.0f - margin, x1 = 1.0f + margin;
+    Parallel::forEach(0, Gplus1, [this, &inverse, x0, x1, y0, y1](int begin, int end) {
+        glm::vec3 p;
+        for (int j = begin; j < end; j++) {
+            float y = y0 + (y1 - y0) * j / grid;
+            for (int i = 0; i < Gplus1; i++) {
+                planeHit(inverse, x0 + (x1 - x0) * i / grid, y, p);
+                rest_x[j * Gplus1 + i] = p.x;
+                rest_z[j * Gplus1 + i] = p.z;
+            }
+        }
+    });
+    return true;
+}
+
+// projects the grid for this camera and samples the last simulation frame under it
+void ProjectedGrid::update(const ogl::Camera &camera) {
+    TRACE_ZONE("ProjectedGrid::update");
+    glm::mat4 model = glm::scale(glm::mat4(1.0f), glm::vec3(scale, scale, scale));
+    glm::mat4 inverse = glm::inverse(camera.projection() * camera.view() * model);
+
+    visible = project(inverse);
+    if (!visible) return;
+
+    const int count = Gplus1 * Gplus1;
+    Parallel::forEach(0, Gplus1, [this, count](int begin, int end) {
+        int first = begin * Gplus1, n = (end - begin) * Gplus1;
+        float *height = samples, *dx = samples + count, *dz = samples + 2 * count;
+        float *nx = samples + 3 * count, *ny = samples + 4 * count, *nz = samples + 5 * count;
+
+        simulation->sampleRest(n, rest_x + first, rest_z + first, height + first, dx + first, dz + first,
+                               nx + first, ny + first, nz + first);
+        for (int k = first; k < first + n; k++) {
+            vertex_ocean &v = vertices[k];
+            v.x  = rest_x[k] + dx[k];
+            v.y  = height[k];
+            v.z  = rest_z[k] + dz[k];
+            v.nx = nx[k];
+            v.ny = ny[k];
+            v.nz = nz[k];
+        }
+    });
+}
+
+void ProjectedGrid::render(ogl::Program* oceanShader, const ogl::Camera &camera) {
+    TRACE_ZONE("ProjectedGrid::render");
+    update(camera);
+    if (!visible) return;
+
+    glBindVertexArray(vao);
+
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_vertices);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertex_ocean) * Gplus1 * Gplus1, vertices);
+
+    glEnable(GL_PRIMITIVE_RESTART);
+    glPrimitiveRestartIndex(restart_index);
+    oceanShader->setUniform("model", glm::scale(glm::mat4(1.0f), glm::vec3(scale, scale, scale)));
+    glDrawElements(GL_TRIANGLE_STRIP, indices_count, index_type, 0);
+    glDisable(GL_PRIMITIVE_RESTART);
+
+    glBindVertexArray(0);
+}
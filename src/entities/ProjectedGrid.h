@@ -0,0 +1,48 @@
+#ifndef PROJECTEDGRID_H
+#define PROJECTEDGRID_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include "../ogl/Program.h"
+#include "../ogl/Camera.h"
+#include "OceanSimulation.h"
+#include "OceanIndices.h"
+#include "OceanRenderer.h"
+
+
+// Draws the ocean as a fixed (grid+1)*(grid+1) mesh laid out in screen space and
+// projected onto the mean water plane every frame, so the vertex cost does not
+// depend on how much water is in view. Each vertex then samples the last
+// simulation frame at its rest position, the surface repeats with the patch.
+class ProjectedGrid {
+  private:
+    const OceanSimulation *simulation;
+    int grid, Gplus1;               // quads per side
+    float scale;                    // world units per simulation unit
+    float margin;                   // extra NDC range covering horizontal displacement
+    unsigned int indices_count;
+    GLenum index_type;
+    GLuint restart_index;
+    vertex_ocean *vertices;         // (grid+1)^2
+    float *rest_x, *rest_z;         // rest positions on the water plane, simulation units
+    float *samples;                 // height, dx, dz, nx, ny, nz per vertex
+    Arena *arena;                   // holds everything above
+    bool visible;                   // the water plane is in view
+    GLuint vbo_vertices, vbo_indices, vao;
+
+    bool project(const glm::mat4 &inverse);
+
+  protected:
+  public:
+    ProjectedGrid(const OceanSimulation *simulation, int grid = 128, float scale = 5.0f);
+    ~ProjectedGrid();
+    void release();
+
+    void enableAttribs(GLint vertex, GLint normal);
+    void update(const ogl::Camera &camera);
+    void render(ogl::Program* shader, const ogl::Camera &camera);
+};
+
+
+#endif
@@ -0,0 +1,110 @@
+#include "SpectrumCache.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+struct spectrum_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t texel_size;        // sizeof(complex), catches layout changes
+    spectrum_key key;
+    uint32_t reserved[4];       // pads the header to 64 bytes
+};
+
+static const char spectrum_magic[8] = { 'W', 'E', 'T', 'S', 'P', 'E', 'C', 0 };
+
+static size_t tableBytes(int N) {
+    size_t texels = (size_t)(N + 1) * (N + 1);
+    return texels * (2 * sizeof(complex) + sizeof(float));
+}
+
+SpectrumCache::SpectrumCache() : mapping(0), size(0), h0(0), h0mk_conj(0), omega(0) { }
+
+SpectrumCache::~SpectrumCache() {
+    if (mapping) munmap(mapping, size);
+}
+
+// file name is derived from the raw bits of every key field so that two different
+// configurations never share a file
+std::string SpectrumCache::fileName(const std::string &dir, const spectrum_key &key) {
+    uint32_t bits[7];
+    memcpy(&bits[0], &key.A,      4);
+    memcpy(&bits[1], &key.wx,     4);
+    memcpy(&bits[2], &key.wz,     4);
+    memcpy(&bits[3], &key.length, 4);
+    memcpy(&bits[4], &key.g,      4);
+    bits[5] = (uint32_t)(key.seed >> 32);
+    bits[6] = (uint32_t)key.seed;
+
+    char name[128];
+    snprintf(name, sizeof(name), "spectrum_v%u_%d_%08x_%08x_%08x_%08x_%08x_%08x%08x.bin",
+             version, key.N, bits[0], bits[1], bits[2], bits[3], bits[4], bits[5], bits[6]);
+    return dir.empty() ? std::string(name) : dir + "/" + name;
+}
+
+bool SpectrumCache::map(const std::string &path, const spectrum_key &key) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    size_t expected = sizeof(spectrum_header) + tableBytes(key.N);
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size != expected) {
+        close(fd);
+        return false;
+    }
+
+    void *p = mmap(0, expected, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return false;
+
+    const spectrum_header *header = (const spectrum_header*)p;
+    if (memcmp(header->magic, spectrum_magic, sizeof(spectrum_magic)) != 0 ||
+        header->version != version || header->texel_size != sizeof(complex) ||
+        memcmp(&header->key, &key, sizeof(spectrum_key)) != 0) {
+        munmap(p, expected);
+        return false;
+    }
+
+    if (mapping) munmap(mapping, size);
+    mapping = p;
+    size    = expected;
+
+    size_t texels = (size_t)(key.N + 1) * (key.N + 1);
+    char *tables  = (char*)p + sizeof(spectrum_header);
+    h0        = (complex*)tables;
+    h0mk_conj = h0 + texels;
+    omega     = (float*)(h0mk_conj + texels);
+    return true;
+}
+
+// written to a temporary file and renamed, so readers never map a partial file
+bool SpectrumCache::write(const std::string &path, const spectrum_key &key,
+                          const complex *h0, const complex *h0mk_conj, const float *omega) {
+    spectrum_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, spectrum_magic, sizeof(spectrum_magic));
+    header.version    = version;
+    header.texel_size = sizeof(complex);
+    header.key        = key;
+
+    std::string tmp = path + ".tmp";
+    FILE *f = fopen(tmp.c_str(), "wb");
+    if (!f) return false;
+
+    size_t texels = (size_t)(key.N + 1) * (key.N + 1);
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+              fwrite(h0,        sizeof(complex), texels, f) == texels &&
+              fwrite(h0mk_conj, sizeof(complex), texels, f) == texels &&
+              fwrite(omega,     sizeof(float),   texels, f) == texels;
+    ok = (fclose(f) == 0) && ok;
+
+    if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+        remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
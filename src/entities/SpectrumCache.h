@@ -0,0 +1,42 @@
+#ifndef SPECTRUMCACHE_H
+#define SPECTRUMCACHE_H
+
+#include <string>
+#include <stdint.h>
+#include "Complex.h"
+
+struct spectrum_key {           // everything the initial spectrum depends on
+    int N;
+    float A;
+    float wx, wz;
+    float length;
+    float g;
+    uint64_t seed;
+};
+
+// Initial ocean spectrum baked to disk. The file is a fixed header followed by
+// the (N+1)*(N+1) tables h0, conj(h0(-k)) and omega, and is mapped copy-on-write
+// so the tables can be used -- and modified -- in place without touching the file.
+class SpectrumCache {
+  private:
+    void *mapping;
+    size_t size;
+
+  protected:
+  public:
+    static const unsigned int version = 2;
+
+    complex *h0, *h0mk_conj;    // point into the mapping once map() succeeded
+    float *omega;
+
+    SpectrumCache();
+    ~SpectrumCache();
+
+    bool map(const std::string &path, const spectrum_key &key);
+
+    static std::string fileName(const std::string &dir, const spectrum_key &key);
+    static bool write(const std::string &path, const spectrum_key &key,
+                      const complex *h0, const complex *h0mk_conj, const float *omega);
+};
+
+#endif
@@ -0,0 +1,150 @@
+#include "Trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace {
+    // Written by its thread only. head counts every event ever recorded, the slot of
+    // event i is i % ring_events; a reader takes head before and after copying and
+    // drops what may have been overwritten in between.
+    struct thread_ring {
+        trace_event events[Trace::ring_events];
+        std::atomic<uint64_t> head;
+        int tid;
+        char name[32];
+    };
+
+    // Rings are never freed, a dump at exit still sees threads that have finished.
+    struct Registry {
+        std::mutex lock;
+        std::vector<thread_ring *> rings;
+        std::string output;
+        bool at_exit;
+
+        Registry() : at_exit(false) { }
+    };
+
+    Registry& registry() {
+        static Registry *r = new Registry;
+        return *r;
+    }
+
+    const std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+    thread_local thread_ring *ring = 0;
+
+    thread_ring* threadRing() {
+        if (ring) return ring;
+        thread_ring *r = new thread_ring;
+        r->head.store(0, std::memory_order_relaxed);
+        r->name[0] = 0;
+        Registry &reg = registry();
+        std::lock_guard<std::mutex> guard(reg.lock);
+        r->tid = reg.rings.size() + 1;
+        reg.rings.push_back(r);
+        ring = r;
+        return r;
+    }
+
+    void writeString(FILE *f, const char *s) {
+        fputc('"', f);
+        for (; *s; s++) {
+            if (*s == '"' || *s == '\\') fputc('\\', f);
+            if ((unsigned char)*s >= 0x20) fputc(*s, f);
+        }
+        fputc('"', f);
+    }
+
+    void dumpAtExit() {
+        Trace::dump();
+    }
+}
+
+uint64_t Trace::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count();
+}
+
+void Trace::record(const char *name, uint64_t begin, uint64_t end) {
+    thread_ring *r = threadRing();
+    uint64_t head = r->head.load(std::memory_order_relaxed);
+    trace_event &e = r->events[head % ring_events];
+    e.name  = name;
+    e.begin = begin;
+    e.end   = end;
+    r->head.store(head + 1, std::memory_order_release);
+}
+
+void Trace::setThreadName(const char *name) {
+    thread_ring *r = threadRing();
+    strncpy(r->name, name, sizeof(r->name) - 1);
+    r->name[sizeof(r->name) - 1] = 0;
+}
+
+void Trace::setOutput(const char *path) {
+    Registry &reg = registry();
+    std::lock_guard<std::mutex> guard(reg.lock);
+    reg.output = path;
+    if (!reg.at_exit) atexit(dumpAtExit);
+    reg.at_exit = true;
+}
+
+bool Trace::dump() {
+    std::string path;
+    {
+        Registry &reg = registry();
+        std::lock_guard<std::mutex> guard(reg.lock);
+        path = reg.output;
+    }
+    return !path.empty() && dump(path.c_str());
+}
+
+// Complete ("X") events with times in microseconds, plus one thread_name metadata
+// event per ring. Other threads may keep recording while this runs.
+bool Trace::dump(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) return false;
+
+    Registry &reg = registry();
+    std::vector<thread_ring *> rings;
+    {
+        std::lock_guard<std::mutex> guard(reg.lock);
+        rings = reg.rings;
+    }
+
+    int pid = getpid();
+    bool first = true;
+    std::vector<trace_event> copy;
+    fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    for (size_t i = 0; i < rings.size(); i++) {
+        thread_ring *r = rings[i];
+        fprintf(f, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":",
+                first ? "" : ",", pid, r->tid);
+        if (r->name[0]) writeString(f, r->name);
+        else            fprintf(f, "\"thread %d\"", r->tid);
+        fprintf(f, "}}");
+        first = false;
+
+        uint64_t head = r->head.load(std::memory_order_acquire);
+        uint64_t start = head > (uint64_t)ring_events ? head - ring_events : 0;
+        copy.resize(head - start);
+        for (uint64_t e = start; e < head; e++) copy[e - start] = r->events[e % ring_events];
+        uint64_t after = r->head.load(std::memory_order_acquire);
+        // slot after % ring_events may be half written by the next record()
+        uint64_t valid = after >= (uint64_t)ring_events ? after - ring_events + 1 : 0;
+
+        for (uint64_t e = start > valid ? start : valid; e < head; e++) {
+            const trace_event &event = copy[e - start];
+            fprintf(f, ",\n{\"name\":");
+            writeString(f, event.name);
+            fprintf(f, ",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                    pid, r->tid, event.begin * 1e-3, (event.end - event.begin) * 1e-3);
+        }
+    }
+    fprintf(f, "\n]}\n");
+    return fclose(f) == 0;
+}
@@ -0,0 +1,58 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+// Scoped trace zones for looking at the frame structure in chrome://tracing or
+// Perfetto. A zone records its name, start and end into a ring buffer owned by the
+// thread it ran on; dump() writes what all the rings hold as Chrome trace JSON.
+// Zones are only compiled in with OCEAN_TRACE defined (make trace=1), otherwise
+// the macros below expand to nothing.
+//
+//   TRACE_ZONE("name")         zone from here to the end of the enclosing scope
+//   TRACE_THREAD("name")       names the calling thread in the trace
+//   TRACE_OUTPUT("trace.json") file for dump(), also written at exit
+#ifdef OCEAN_TRACE
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+#define TRACE_ZONE(name) TraceZone TRACE_CONCAT(trace_zone_, __LINE__)(name)
+#define TRACE_THREAD(name) Trace::setThreadName(name)
+#define TRACE_OUTPUT(path) Trace::setOutput(path)
+#else
+#define TRACE_ZONE(name)
+#define TRACE_THREAD(name)
+#define TRACE_OUTPUT(path)
+#endif
+
+struct trace_event {
+    const char *name;           // string literal, the pointer is all that is kept
+    uint64_t begin, end;        // ns since the first event of the process
+};
+
+class Trace {
+  private:
+  protected:
+  public:
+    static const int ring_events = 1 << 16;     // per thread, older events are overwritten
+
+    static uint64_t now();
+    static void record(const char *name, uint64_t begin, uint64_t end);
+    static void setThreadName(const char *name);
+
+    static void setOutput(const char *path);    // and dumps there at exit
+    static bool dump();                         // to the setOutput() path
+    static bool dump(const char *path);
+};
+
+class TraceZone {
+  private:
+    const char *name;
+    uint64_t begin;
+
+  protected:
+  public:
+    TraceZone(const char *name) : name(name), begin(Trace::now()) { }
+    ~TraceZone() { Trace::record(name, begin, Trace::now()); }
+};
+
+#endif
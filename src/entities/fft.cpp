@@ -1,6 +1,6 @@
 #include "fft.h"
 
-cFFT::cFFT(unsigned int N) : N(N), reversed(0), T(0), pi2(2 * M_PI) {
+cFFT::cFFT(unsigned int N) : N(N), reversed(0), T(0), pi2(2 * M_PI), live(0), multiplies(0) {
 	c[0] = c[1] = 0;
 
 	log_2_N = log(N)/log(2);
@@ -18,6 +18,7 @@ cFFT::cFFT(unsigned int N) : N(N), reversed(0), T(0), pi2(2 * M_PI) {
 
 	c[0] = new complex[N];
 	c[1] = new complex[N];
+	live = new unsigned char[N];
 	which = 0;
 }
 
@@ -29,6 +30,7 @@ cFFT::~cFFT() {
 		delete [] T;
 	}
 	if (reversed) delete [] reversed;
+	if (live) delete [] live;
 }
 
 unsigned int cFFT::reverse(unsigned int i) {
@@ -44,7 +46,12 @@ complex cFFT::t(unsigned int x, unsigned int N) {
 	return complex(cos(pi2 * x / N), sin(pi2 * x / N));
 }
 
-void cFFT::fft(complex* input, complex* output, int stride, int offset) {
+void cFFT::fft(complex* input, complex* output, int stride, int offset, const unsigned char *nonzero) {
+	if (nonzero) {
+		prunedFFT(input, output, stride, offset, nonzero);
+		return;
+	}
+
 	for (int i = 0; i < N; i++) c[which][i] = input[reversed[i] * stride + offset];
 
 	int loops       = N>>1;
@@ -70,5 +77,56 @@ void cFFT::fft(complex* input, complex* output, int stride, int offset) {
 		w_++;
 	}
 
+	multiplies += (N >> 1) * log_2_N;
+
 	for (int i = 0; i < N; i++) output[i * stride + offset] = c[which][i];
-}
\ No newline at end of file
+}
+
+// Same transform for inputs that are mostly zero. nonzero[i] flags input i in natural
+// order (unit stride, whatever the data stride). Each block of the butterfly network
+// tracks whether anything nonzero feeds it: dead blocks are never computed or read,
+// a block with one dead half is a copy or a single twiddle multiply.
+void cFFT::prunedFFT(complex* input, complex* output, int stride, int offset, const unsigned char *nonzero) {
+	for (unsigned int i = 0; i < N; i++) {
+		live[i] = nonzero[reversed[i]];
+		if (live[i]) c[which][i] = input[reversed[i] * stride + offset];
+	}
+
+	int loops       = N>>1;
+	int size        = 1<<1;
+	int size_over_2 = 1;
+	int w_          = 0;
+	for (unsigned int i = 1; i <= log_2_N; i++) {
+		which ^= 1;
+		complex *in = c[which^1], *out = c[which];
+		for (int j = 0; j < loops; j++) {
+			int even = live[2 * j], odd = live[2 * j + 1];
+			live[j] = even | odd;
+			complex *e = in + size * j, *o = e + size_over_2, *r = out + size * j;
+			if (even && odd) {
+				for (int k = 0; k < size_over_2; k++) {
+					complex x = o[k] * T[w_][k];
+					r[k]               = e[k] + x;
+					r[k + size_over_2] = e[k] - x;
+				}
+				multiplies += size_over_2;
+			} else if (even) {
+				for (int k = 0; k < size_over_2; k++) r[k] = r[k + size_over_2] = e[k];
+			} else if (odd) {
+				for (int k = 0; k < size_over_2; k++) {
+					complex x = o[k] * T[w_][k];
+					r[k]               = x;
+					r[k + size_over_2] = -x;
+				}
+				multiplies += size_over_2;
+			}
+		}
+		loops       >>= 1;
+		size        <<= 1;
+		size_over_2 <<= 1;
+		w_++;
+	}
+
+	if (live[0]) for (unsigned int i = 0; i < N; i++) output[i * stride + offset] = c[which][i];
+	else         for (unsigned int i = 0; i < N; i++) output[i * stride + offset] = complex(0.0f, 0.0f);
+}
@@ -12,13 +12,16 @@ class cFFT {
 	unsigned int *reversed;
 	complex **T;
 	complex *c[2];
+	unsigned char *live;		// per block: any nonzero input below it (pruned transform)
+	void prunedFFT(complex* input, complex* output, int stride, int offset, const unsigned char *nonzero);
   protected:
   public:
+	unsigned int multiplies;	// twiddle multiplies performed, reset by the caller
 	cFFT(unsigned int N);
 	~cFFT();
 	unsigned int reverse(unsigned int i);
 	complex t(unsigned int x, unsigned int N);
-	void fft(complex* input, complex* output, int stride, int offset);
+	void fft(complex* input, complex* output, int stride, int offset, const unsigned char *nonzero = 0);
 };
 
 #endif
\ No newline at end of file
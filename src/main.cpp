@@ -8,6 +8,9 @@
 #include <iostream>
 #include <stdexcept>
 #include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
 #include <list>
 
 // ogl classes
@@ -19,7 +22,11 @@
 #include "Helper.h"
 
 // Entities
-#include "entities/Ocean.h"
+#include "entities/OceanSimulation.h"
+#include "entities/OceanRenderer.h"
+#include "entities/ProjectedGrid.h"
+#include "entities/OceanTessellation.h"
+#include "entities/Trace.h"
 
 using namespace std;
 
@@ -73,7 +80,13 @@ std::list<ModelInstance> gInstances;
 GLuint cubemap;
 ogl::cObj* dragon;
 
-Ocean* ocean;
+OceanSimulation* ocean;
+OceanRenderer* oceanRenderer;
+ProjectedGrid* oceanGrid;
+OceanTessellation* oceanTessellation = 0;  // 0 without GL 4 tessellation
+ogl::Program* oceanTessShader = 0;
+OceanPublisher oceanPublisher;             // shares frames when OCEAN_SHM names a segment
+enum { OCEAN_TILES, OCEAN_PROJECTED, OCEAN_TESSELLATED } gOceanMode = OCEAN_TILES;    // O, P, T
 ogl::Program* oceanShader;
 
 double elapsed = 0;
@@ -84,6 +97,7 @@ static std::string ResourcePath(std::string fileName) {
 }
 
 static ogl::Cubemap* loadCubemap(std::string dir, std::string extension) {
+    TRACE_ZONE("loadCubemap");
     ogl::Bitmap bk = ogl::Bitmap::bitmapFromFile(ResourcePath(dir + "bk." + extension));
     bk.flipVertically();
     ogl::Bitmap dn = ogl::Bitmap::bitmapFromFile(ResourcePath(dir + "dn." + extension));
@@ -126,6 +140,7 @@ static ogl::Cubemap* loadCubemap(std::string dir, std::string extension) {
 }
 
 static ogl::Texture* LoadTexture(const char* filename) {
+    TRACE_ZONE("LoadTexture");
     ogl::Bitmap bmp = ogl::Bitmap::bitmapFromFile(ResourcePath(filename));
     bmp.flipVertically();
     return new ogl::Texture(bmp);
@@ -133,25 +148,60 @@ static ogl::Texture* LoadTexture(const char* filename) {
 
 // loads the vertex shader and fragment shader, and links them to make the global gProgram
 static ogl::Program* LoadShaders(const char* vertFilename, const char* fragFilename) {
+    TRACE_ZONE("LoadShaders");
     std::vector<ogl::Shader> shaders;
     shaders.push_back(ogl::Shader::shaderFromFile(ResourcePath(vertFilename), GL_VERTEX_SHADER));
     shaders.push_back(ogl::Shader::shaderFromFile(ResourcePath(fragFilename), GL_FRAGMENT_SHADER));
     return new ogl::Program(shaders);
 }
 
+static ogl::Program* LoadTessShaders(const char* vertFilename, const char* tescFilename,
+                                     const char* teseFilename, const char* fragFilename) {
+    TRACE_ZONE("LoadTessShaders");
+    std::vector<ogl::Shader> shaders;
+    shaders.push_back(ogl::Shader::shaderFromFile(ResourcePath(vertFilename), GL_VERTEX_SHADER));
+    shaders.push_back(ogl::Shader::shaderFromFile(ResourcePath(tescFilename), GL_TESS_CONTROL_SHADER));
+    shaders.push_back(ogl::Shader::shaderFromFile(ResourcePath(teseFilename), GL_TESS_EVALUATION_SHADER));
+    shaders.push_back(ogl::Shader::shaderFromFile(ResourcePath(fragFilename), GL_FRAGMENT_SHADER));
+    return new ogl::Program(shaders);
+}
+
 static void loadOcean() {
+    TRACE_ZONE("loadOcean");
     oceanShader = LoadShaders("res/shaders/ocean/vert.glsl", "res/shaders/ocean/frag.glsl");
-    ocean = new Ocean(128, 0.0005f, vector2(32.0f, 32.0f), 64, false);
-    ocean->enableAttribs(oceanShader->attrib("vertex"), oceanShader->attrib("normal"));
+    ocean = new OceanSimulation(128, 0.0005f, vector2(32.0f, 32.0f), 64);
+    ocean->setSimulationRate(30.0f);        // FFT steps per second of ocean time, blended in between
+    if (const char *segment = getenv("OCEAN_SHM")) {
+        if (oceanPublisher.create(segment, ocean->resolution())) ocean->setPublisher(&oceanPublisher);
+        else std::cerr << "could not create shared memory segment " << segment << ": " << strerror(errno) << std::endl;
+    }
+    oceanRenderer = new OceanRenderer(ocean, false);
+    oceanRenderer->enableAttribs(oceanShader->attrib("vertex"), oceanShader->attrib("normal"));
+    oceanGrid = new ProjectedGrid(ocean, 192);
+    oceanGrid->enableAttribs(oceanShader->attrib("vertex"), oceanShader->attrib("normal"));
+
+    // optional, the tiles stay the fallback when the driver or the shaders say no
+    if (OceanTessellation::supported()) {
+        try {
+            oceanTessShader = LoadTessShaders("res/shaders/ocean/tess/vert.glsl", "res/shaders/ocean/tess/tesc.glsl",
+                                              "res/shaders/ocean/tess/tese.glsl", "res/shaders/ocean/frag.glsl");
+            oceanTessellation = new OceanTessellation(ocean);
+            oceanTessellation->enableAttribs(oceanTessShader->attrib("vertex"));
+        } catch (const std::exception& e) {
+            std::cerr << "ocean tessellation disabled: " << e.what() << std::endl;
+        }
+    }
 }
 
 static void loadDragon(string filename){
+    TRACE_ZONE("loadDragon");
     dragon = new ogl::cObj("res/dragon_smooth.obj");
     gDragon.shaders = LoadShaders("res/shaders/shiny/vert.glsl", "res/shaders/shiny/frag.glsl");
     gDragon.drawCount = dragon->setupBufferObjects(gDragon.shaders->attrib("vertex"), gDragon.shaders->attrib("normal"));
 }
 
 static void loadSkybox() {
+    TRACE_ZONE("loadSkybox");
     loadCubemap("res/stormy/", "tga");
     gSkybox.shaders = LoadShaders("res/shaders/skybox/vert.glsl", "res/shaders/skybox/frag.glsl");
     gSkybox.drawType = GL_TRIANGLES;
@@ -220,6 +270,7 @@ static void loadSkybox() {
 }
 
 static void LoadWoodenCrateAsset() {
+    TRACE_ZONE("LoadWoodenCrateAsset");
     gWoodenCrate.shaders = LoadShaders("res/shaders/shiny/vert.glsl", "res/shaders/shiny/frag.glsl");
     gWoodenCrate.drawType = GL_TRIANGLES;
     gWoodenCrate.drawStart = 0;
@@ -346,6 +397,7 @@ static void CreateInstances() {
 }
 
 static void renderSkybox() {
+    TRACE_ZONE("renderSkybox");
     ogl::Program* shaders = gSkybox.shaders;
     //bind the shaders
     shaders->use();
@@ -369,6 +421,7 @@ static void renderSkybox() {
 }
 
 static void RenderInstance(const ModelInstance& inst) {
+    TRACE_ZONE("RenderInstance");
     ModelAsset* asset = inst.asset;
     ogl::Program* shaders = asset->shaders;
 
@@ -408,24 +461,31 @@ static void RenderInstance(const ModelInstance& inst) {
 }
 
 static void renderOcean() {
-    oceanShader->use();
+    TRACE_ZONE("renderOcean");
+    bool tessellated = gOceanMode == OCEAN_TESSELLATED && oceanTessellation;
+    ogl::Program* shader = tessellated ? oceanTessShader : oceanShader;
+
+    shader->use();
 
-    oceanShader->setUniform("light_position", gLight.position);
-    oceanShader->setUniform("view", gCamera.view());
-    oceanShader->setUniform("projection", gCamera.projection());
+    shader->setUniform("light_position", gLight.position);
+    shader->setUniform("view", gCamera.view());
+    shader->setUniform("projection", gCamera.projection());
 
        //bind the texture
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap);
 
-    ocean->render(oceanShader);
+    if (tessellated)                         oceanTessellation->render(shader, SCREEN_SIZE);
+    else if (gOceanMode == OCEAN_PROJECTED)  oceanGrid->render(shader, gCamera);
+    else                                     oceanRenderer->render(shader);
 
     glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
 
-    oceanShader->stopUsing();
+    shader->stopUsing();
 }
 
 static void renderDragon() {
+    TRACE_ZONE("renderDragon");
     gDragon.shaders->use();
 
     gDragon.shaders->setUniform("view", gCamera.view());
@@ -445,6 +505,7 @@ static void renderDragon() {
 
 // draws a single frame
 static void render() {
+    TRACE_ZONE("render");
     // clear everything
     glClearColor(0, 0, 1, 1);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -460,15 +521,17 @@ static void render() {
     renderOcean();
     
     // swap the display buffers (displays what was just drawn)
+    TRACE_ZONE("glfwSwapBuffers");
     glfwSwapBuffers();
 }
 
 static void update(float dt) {
+    TRACE_ZONE("update");
     const GLfloat moveSpeed = 20.0f;
 
     elapsed += dt / 5.f;
 
-    ocean->evaluateWavesFFT(elapsed);
+    ocean->evaluate(elapsed);
 
     gLight.position = gCamera.position();
 
@@ -489,11 +552,30 @@ static void update(float dt) {
     } else if(glfwGetKey('X')){
         gCamera.offsetPosition(dt * moveSpeed * glm::vec3(0,1,0));
     }
+
+    if(glfwGetKey('P')){
+        gOceanMode = OCEAN_PROJECTED;
+    } else if(glfwGetKey('T')){
+        gOceanMode = OCEAN_TESSELLATED;
+    } else if(glfwGetKey('O')){
+        gOceanMode = OCEAN_TILES;
+    }
+
+#ifdef OCEAN_TRACE
+    // F12 writes out what the trace rings hold so far
+    static bool dumping = false;
+    bool pressed = glfwGetKey(GLFW_KEY_F12) == GLFW_PRESS;
+    if (pressed && !dumping && Trace::dump()) std::cerr << "trace written" << std::endl;
+    dumping = pressed;
+#endif
 }
 
 
 // the program starts here
 int main(int argc, char *argv[]) {
+    TRACE_THREAD("main");
+    TRACE_OUTPUT(getenv("OCEAN_TRACE_FILE") ? getenv("OCEAN_TRACE_FILE") : "trace.json");
+
     // initialise GLFW
     if(!glfwInit())
         throw std::runtime_error("glfwInit failed");
@@ -543,6 +625,7 @@ int main(int argc, char *argv[]) {
     // run while the window is open
     double endTime = glfwGetTime();
     while(glfwGetWindowParam(GLFW_OPENED)){
+        TRACE_ZONE("frame");
         double startTime = glfwGetTime();
         // draw one frame
         update(startTime - endTime);
@@ -557,6 +640,7 @@ int main(int argc, char *argv[]) {
 
         render();
 
+        TRACE_ZONE("glGetError");
         GLenum error = glGetError();
         if(error != GL_NO_ERROR)
             std::cerr << "OpenGL Error " << error << ": " << (const char*)gluErrorString(error) << std::endl;
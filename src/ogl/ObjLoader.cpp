@@ -1,8 +1,10 @@
 #include "ObjLoader.h"
+#include "../entities/Trace.h"
 
 using namespace ogl;
 
 cObj::cObj(std::string filename) {
+	TRACE_ZONE("cObj parse");
 	std::ifstream ifs(filename.c_str(), std::ifstream::in);
 	std::string line, key;
 	while (ifs.good() && !ifs.eof() && std::getline(ifs, line)) {
@@ -0,0 +1,46 @@
+// Index buffers of every topology and order, at a size that fits 16 bit indices and
+// one that needs 32 bit. Prints OceanIndices::report for both, then checks that each
+// buffer covers the 2 N^2 triangles of the grid with indices inside it, and that the
+// block and Morton orders reuse the post-transform cache better than plain rows.
+//
+//   test_indices
+#include "../entities/OceanIndices.h"
+#include <stdio.h>
+
+int main() {
+    const char *topologies[] = { "triangles", "strips" };
+    const char *orders[]     = { "rows", "blocks", "morton" };
+    const int sizes[] = { 64, 256 };
+    int failed = 0;
+
+    for (int s = 0; s < 2; s++) {
+        int N = sizes[s];
+        OceanIndices::report(N);
+        for (int topology = 0; topology < 2; topology++) {
+            float acmr[3];
+            for (int order = 0; order < 3; order++) {
+                OceanIndices indices(N, (index_topology)topology, (index_order)order);
+                acmr[order] = indices.acmr();
+                unsigned int vertices = (N + 1) * (N + 1), outside = 0;
+                for (unsigned int i = 0; i < indices.indexCount(); i++) {
+                    unsigned int v = indices.index(i);
+                    if (v >= vertices && !(topology == INDEX_STRIPS && v == indices.restartIndex())) outside++;
+                }
+                if (indices.triangleCount() != 2u * N * N || outside || indices.wideIndices() != (N == 256)) {
+                    printf("N = %d %s %s: %u triangles, %u indices outside the grid, %d bit  FAILED\n",
+                           N, topologies[topology], orders[order], indices.triangleCount(), outside,
+                           indices.wideIndices() ? 32 : 16);
+                    failed++;
+                }
+            }
+            for (int order = INDEX_BLOCKS; order <= INDEX_MORTON; order++) {
+                if (acmr[order] < acmr[INDEX_ROWS]) continue;
+                printf("N = %d %s: %s ACMR %.3f is no better than rows %.3f  FAILED\n",
+                       N, topologies[topology], orders[order], acmr[order], acmr[INDEX_ROWS]);
+                failed++;
+            }
+        }
+    }
+    printf("%d checks failed\n", failed);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,41 @@
+// Parallel::forEach across pool resizes. Every job checks that each index is visited
+// exactly once and that no chunk runs with the tag of an earlier job, which is what a
+// worker spawned by a resize did when it picked up the job before its time.
+//
+//   test_parallel [iterations]
+#include "../entities/Parallel.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <vector>
+#include <thread>
+#include <chrono>
+
+static std::atomic<int> current(0);
+static std::atomic<int> stale(0);
+
+static bool job(int tag, int count) {
+    std::vector<std::atomic<int> > visits(count);
+    for (int i = 0; i < count; i++) visits[i].store(0);
+    current.store(tag);
+    Parallel::forEach(0, count, [tag, &visits](int begin, int end) {
+        if (tag != current.load()) stale++;
+        for (int i = begin; i < end; i++) visits[i]++;
+    });
+    for (int i = 0; i < count; i++)
+        if (visits[i].load() != 1) return false;
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 1000;
+    int failed = 0, tag = 0;
+    for (int i = 0; i < iterations; i++) {
+        Parallel::setThreads(2 + i % 3);
+        std::this_thread::sleep_for(std::chrono::microseconds(50));     // lets the new workers wake
+        for (int j = 0; j < 3; j++)
+            if (!job(++tag, 1 + (i * 7 + j) % 64)) failed++;
+    }
+    printf("%d jobs, %d with wrong visit counts, %d stale chunk calls\n", tag, failed, stale.load());
+    return failed || stale.load() ? 1 : 0;
+}
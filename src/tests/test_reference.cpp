@@ -0,0 +1,48 @@
+// The FFT path against the direct sum (compareReference) at small resolutions. The
+// full transform has to agree to float rounding; with pruning the error has to stay
+// within the bound pruneStats() reports for the dropped bins. The difference normals
+// lean with the choppy displacement and differ from the FFT ones by a few degrees
+// RMS (compareNormals), which must leave the FFT normal mode as it was.
+//
+//   test_reference
+#include "../entities/OceanSimulation.h"
+#include <stdio.h>
+
+static int failed = 0;
+
+static void check(bool ok, int N, const char *what, float value, float limit) {
+    printf("N = %3d %-28s %10.3g  (limit %.3g)%s\n", N, what, value, limit, ok ? "" : "  FAILED");
+    if (!ok) failed++;
+}
+
+int main() {
+    const float t = 3.3f;
+    for (int N = 16; N <= 64; N *= 2) {
+        ocean_reference_error error;
+        {
+            OceanSimulation simulation(N, 0.0005f, vector2(32.0f, 32.0f), 64);
+            simulation.compareReference(t, error);
+            check(error.height_max < 1e-4f, N, "height max", error.height_max, 1e-4f);
+            check(error.displacement_max < 1e-4f, N, "displacement max", error.displacement_max, 1e-4f);
+            check(error.normal_max_degrees < 1e-2f, N, "normal max (degrees)", error.normal_max_degrees, 1e-2f);
+        }
+        {
+            OceanSimulation simulation(N, 0.0005f, vector2(32.0f, 32.0f), 64);
+            simulation.setPruneThreshold(1e-4f);
+            simulation.compareReference(t, error);
+            float bound = simulation.pruneStats().height_error;
+            check(error.height_max <= bound, N, "pruned height max", error.height_max, bound);
+            check(error.displacement_max <= bound, N, "pruned displacement max", error.displacement_max, bound);
+        }
+        {
+            OceanSimulation simulation(N, 0.0005f, vector2(32.0f, 32.0f), 64);
+            float max_degrees, rms_degrees;
+            simulation.compareNormals(t, max_degrees, rms_degrees);
+            check(rms_degrees < 20.0f, N, "difference normals rms (deg)", rms_degrees, 20.0f);
+            simulation.compareReference(t, error);
+            check(error.normal_max_degrees < 1e-2f, N, "normal max after compare", error.normal_max_degrees, 1e-2f);
+        }
+    }
+    printf("%d checks failed\n", failed);
+    return failed ? 1 : 0;
+}